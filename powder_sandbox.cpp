@@ -1,14 +1,35 @@
 #include <ncurses.h>
 #include <vector>
+#include <array>
+#include <utility>
 #include <string>
-#include <random>
+#include <cstdint>
 #include <chrono>
 #include <algorithm>
 #include <cmath>
 #include <climits>
+#include <cstddef>
+#include <new>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include <unistd.h>
 
 // ===== Elements =====
-enum class Element {
+enum class Element : uint8_t {
     EMPTY,
     // powders
     SAND, GUNPOWDER, ASH, SNOW,
@@ -23,258 +44,878 @@ enum class Element {
     FIRE, LIGHTNING, HUMAN, ZOMBIE
 };
 
-struct Cell {
-    Element type = Element::EMPTY;
-    int life = 0;        // age / gas lifetime / charge / wetness / anim tick
+// ===== World storage =====
+// One flat row-major world, structure-of-arrays: a byte plane of element types
+// and a parallel plane of life values (age / gas lifetime / charge / wetness /
+// anim tick). Cell (x,y) lives at index y*gWidth+x in both.
+//
+// Planes are anonymous mappings that start out all zero (EMPTY, life 0), so
+// the OS only backs a page once something is written to it: a huge world
+// that is mostly sky costs memory only where there is, or was, matter. Pages
+// run along rows, so a tall thin structure still backs a page of every plane
+// in each row it crosses.
+// zero() hands whole pages back, which is how chunks that empty out return
+// their memory (see release_chunks).
+template<class T>
+class Plane {
+public:
+    Plane() = default;
+    Plane(const Plane&) = delete;
+    Plane& operator=(const Plane&) = delete;
+    ~Plane(){ unmap(); }
+
+    // n cells, all zero; the old contents are dropped
+    void reset(size_t n){
+        unmap();
+        n_=n;
+        if(!n) return;
+        void* m=mmap(nullptr, bytes(), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|NORESERVE, -1, 0);
+        if(m==MAP_FAILED) throw std::bad_alloc();
+        p_=static_cast<T*>(m);
+    }
+
+    // zero cells [first,last); whole pages inside the range go back to the OS
+    void zero(size_t first, size_t last){
+        char* a=reinterpret_cast<char*>(p_+first);
+        // past the last cell the mapping is ours to the end of its page
+        char* b= last==n_ ? reinterpret_cast<char*>(p_)+bytes() : reinterpret_cast<char*>(p_+last);
+        char* pa=a+(page()-(uintptr_t)a%page())%page();
+        char* pb=b-(uintptr_t)b%page();
+        if(pa>=pb || mmap(pa, pb-pa, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED|NORESERVE, -1, 0)==MAP_FAILED){
+            std::memset(a,0,b-a);
+            return;
+        }
+        std::memset(a,0,pa-a);
+        std::memset(pb,0,b-pb);
+    }
+    void zero(){ zero(0,n_); }
+
+    void swap(Plane& o){ std::swap(p_,o.p_); std::swap(n_,o.n_); }
+
+    // cells per page; page p holds cells [p*per_page(), (p+1)*per_page())
+    static size_t per_page(){ return page()/sizeof(T); }
+
+    size_t size() const { return n_; }
+    T& operator[](size_t i){ return p_[i]; }
+    const T& operator[](size_t i) const { return p_[i]; }
+    T* begin(){ return p_; }
+    T* end(){ return p_+n_; }
+
+private:
+#ifdef MAP_NORESERVE
+    static constexpr int NORESERVE = MAP_NORESERVE;
+#else
+    static constexpr int NORESERVE = 0;
+#endif
+    T* p_=nullptr;
+    size_t n_=0;
+
+    static size_t page(){
+        static const size_t ps=(size_t)sysconf(_SC_PAGESIZE);
+        return ps;
+    }
+    size_t bytes() const { return (n_*sizeof(T)+page()-1)/page()*page(); }
+    void unmap(){
+        if(p_) munmap(p_, bytes());
+        p_=nullptr;
+        n_=0;
+    }
 };
 
 static int gWidth = 0, gHeight = 0;
-static std::vector<std::vector<Cell>> grid;
+static Plane<Element> gType;
+static Plane<int>     gLife;
+
+// Per-cell "already handled this tick" stamp. A cell is done when its stamp
+// equals gTick, so nothing needs clearing between ticks; the plane is only
+// re-zeroed when the 8-bit tick counter wraps.
+static Plane<uint8_t> gStamp;
+static uint8_t gTick = 0;
+
+// How many ticks in a row a liquid cell has wandered sideways without
+// finding anywhere lower. It travels with the cell (swap_cells) and is reset
+// by falling, by liquid landing on top, or by the cell being replaced; at
+// LIQUID_SETTLE the cell is settled and stops wandering, so a levelled pool
+// goes to sleep. Transient like the stamps: not saved with the world.
+static Plane<uint8_t> gRest;
+static constexpr uint8_t LIQUID_SETTLE = 128;
+static uint64_t gFrame = 0;   // ticks simulated this session (saved with the world)
+
+static inline int idx(int x,int y){ return y*gWidth+x; }
+
+// Cell indices are plain ints, so a world may hold at most INT_MAX cells.
+static constexpr bool world_fits(int64_t w,int64_t h){ return w>0 && h>0 && w*h<=INT_MAX; }
+
+// ===== Sleeping chunks =====
+// The world is tiled into CHUNK x CHUNK chunks, each with a dirty rect of
+// cells that must be visited. Any change to a cell grows the rect of every
+// chunk touching that cell's 3x3 neighbourhood, both for the tick in progress
+// (so the sweep still reaches it if it has not passed yet) and for the next
+// one. step_sim only visits cells inside the current rects, so chunks where
+// nothing changed last tick cost nothing.
+static constexpr int CHUNK = 32;
+static constexpr int MAX_FLOW = 5;   // furthest a liquid scans sideways per tick
+
+struct DirtyRect {
+    // Inclusive bounds; x0>x1 means asleep. Each bound is an independent
+    // atomic min/max so parallel chunks can grow a shared neighbour's rect.
+    std::atomic<int> x0{INT_MAX}, y0{INT_MAX}, x1{INT_MIN}, y1{INT_MIN};
+
+    bool empty() const { return x0.load(std::memory_order_relaxed)>x1.load(std::memory_order_relaxed); }
+    void clear(){
+        x0.store(INT_MAX,std::memory_order_relaxed); y0.store(INT_MAX,std::memory_order_relaxed);
+        x1.store(INT_MIN,std::memory_order_relaxed); y1.store(INT_MIN,std::memory_order_relaxed);
+    }
+    void grow(int ax,int ay,int bx,int by){
+        if(x0.load(std::memory_order_relaxed)<=ax && y0.load(std::memory_order_relaxed)<=ay &&
+           x1.load(std::memory_order_relaxed)>=bx && y1.load(std::memory_order_relaxed)>=by) return;
+        lower(x0,ax); lower(y0,ay);
+        raise(x1,bx); raise(y1,by);
+    }
+private:
+    static void lower(std::atomic<int>& a,int v){
+        int cur=a.load(std::memory_order_relaxed);
+        while(v<cur && !a.compare_exchange_weak(cur,v,std::memory_order_relaxed)){}
+    }
+    static void raise(std::atomic<int>& a,int v){
+        int cur=a.load(std::memory_order_relaxed);
+        while(v>cur && !a.compare_exchange_weak(cur,v,std::memory_order_relaxed)){}
+    }
+};
 
-static std::mt19937 rng(
-    (unsigned)std::chrono::high_resolution_clock::now().time_since_epoch().count()
-);
+static int gChunksW = 0, gChunksH = 0;
+static std::vector<DirtyRect> gDirtyCur, gDirtyNext;
+static bool gSleepChunks = true;
+
+static void wake_area(int ax,int ay,int bx,int by){
+    ax=std::max(ax,0); ay=std::max(ay,0);
+    bx=std::min(bx,gWidth-1); by=std::min(by,gHeight-1);
+    if(ax>bx || ay>by) return;
+    for(int cy=ay/CHUNK; cy<=by/CHUNK; ++cy){
+        int ry0=std::max(ay,cy*CHUNK), ry1=std::min(by,cy*CHUNK+CHUNK-1);
+        for(int cx=ax/CHUNK; cx<=bx/CHUNK; ++cx){
+            int rx0=std::max(ax,cx*CHUNK), rx1=std::min(bx,cx*CHUNK+CHUNK-1);
+            int k=cy*gChunksW+cx;
+            gDirtyCur[k].grow(rx0,ry0,rx1,ry1);
+            gDirtyNext[k].grow(rx0,ry0,rx1,ry1);
+        }
+    }
+}
+static inline void wake(int x,int y){ wake_area(x-1,y-1,x+1,y+1); }
+// A cell changed type: besides its neighbours, liquids up to MAX_FLOW cells
+// along its row and the one above may now have somewhere to go.
+static inline void wake_changed(int x,int y){ wake_area(x-MAX_FLOW,y-1,x+MAX_FLOW,y+1); }
+static inline void wake_index(int i){ int y=i/gWidth; wake(i-y*gWidth,y); }
+static void wake_all(){ wake_area(0,0,gWidth-1,gHeight-1); }
+
+// How many cells of each chunk aren't EMPTY, kept by the world setters
+// (atomic for the same reason as the rects). A chunk that is swept is marked
+// backed, since even its empty cells get stamped; once a backed chunk is
+// asleep and empty, release_chunks hands its pages back to the OS, except
+// those it shares with chunks that still hold something.
+static Plane<std::atomic<int>> gChunkUsed;
+static Plane<uint8_t> gChunkBacked;
+
+static inline int chunk_of(int x,int y){ return (y/CHUNK)*gChunksW + x/CHUNK; }
+static inline void count_used(int x,int y,int d){
+    gChunkUsed[chunk_of(x,y)].fetch_add(d,std::memory_order_relaxed);
+}
 
-static inline bool in_bounds(int x, int y){ return x>=0 && x<gWidth && y>=0 && y<gHeight; }
-static inline int  rint(int a,int b){ std::uniform_int_distribution<int> d(a,b); return d(rng); }
-static inline bool chance(int p){ std::uniform_int_distribution<int> d(1,100); return d(rng)<=p; }
-static inline bool empty(const Cell& c){ return c.type==Element::EMPTY; }
+// fn(x,y) for every cell of every chunk holding matter
+template<class Fn>
+static void for_used_cells(Fn fn){
+    for(int cy=0;cy<gChunksH;++cy)
+        for(int cx=0;cx<gChunksW;++cx){
+            if(!gChunkUsed[cy*gChunksW+cx].load(std::memory_order_relaxed)) continue;
+            for(int y=cy*CHUNK; y<std::min(gHeight,cy*CHUNK+CHUNK); ++y)
+                for(int x=cx*CHUNK; x<std::min(gWidth,cx*CHUNK+CHUNK); ++x) fn(x,y);
+        }
+}
 
-// classification helpers
-static inline bool sandlike(Element e){
-    return e==Element::SAND || e==Element::GUNPOWDER || e==Element::ASH || e==Element::SNOW;
+// A fresh world is all EMPTY, so every chunk starts asleep; whatever is put
+// in it through the setters wakes itself, and decode_world wakes the lot.
+static void init_chunks(){
+    gChunksW=(gWidth+CHUNK-1)/CHUNK;
+    gChunksH=(gHeight+CHUNK-1)/CHUNK;
+    gDirtyCur=std::vector<DirtyRect>((size_t)gChunksW*gChunksH);
+    gDirtyNext=std::vector<DirtyRect>((size_t)gChunksW*gChunksH);
+    gChunkUsed.reset((size_t)gChunksW*gChunksH);
+    gChunkBacked.reset((size_t)gChunksW*gChunksH);
 }
-static inline bool liquid(Element e){
-    switch(e){
-        case Element::WATER: case Element::SALTWATER: case Element::OIL:
-        case Element::ETHANOL: case Element::ACID: case Element::LAVA:
-        case Element::MERCURY: return true;
-        default: return false;
+
+// Recount gChunkUsed from the type plane, after it was written directly.
+static void recount_chunks(){
+    gChunkUsed.zero();
+    for(int y=0;y<gHeight;++y)
+        for(int x=0;x<gWidth;++x)
+            if(gType[idx(x,y)]!=Element::EMPTY) count_used(x,y,1);
+}
+
+// true when every chunk holding one of cells [first,last) is empty
+static bool cells_unused(size_t first, size_t last){
+    const int y0=(int)(first/gWidth), y1=(int)((last-1)/gWidth);
+    const int x0= y0==y1 ? (int)(first%gWidth) : 0;
+    const int x1= y0==y1 ? (int)((last-1)%gWidth) : gWidth-1;
+    for(int cy=y0/CHUNK; cy<=y1/CHUNK; ++cy)
+        for(int cx=x0/CHUNK; cx<=x1/CHUNK; ++cx)
+            if(gChunkUsed[cy*gChunksW+cx].load(std::memory_order_relaxed)) return false;
+    return true;
+}
+
+// Give back the pages of `plane` under the given chunks (in index order)
+// that no chunk in use shares. Walking their row segments in order visits
+// pages in order too, so each page is looked at once however many chunks
+// share it, and runs of free pages are zeroed in one go.
+template<class T>
+static void release_pages(Plane<T>& plane, const std::vector<int>& chunks){
+    const size_t per=Plane<T>::per_page();
+    auto cells=[&](size_t p){ return std::min(plane.size(),(p+1)*per); };
+    size_t run0=0, run1=0;   // free pages not yet zeroed: [run0,run1)
+    auto flush=[&]{ if(run1>run0) plane.zero(run0*per, cells(run1-1)); run0=run1=0; };
+    size_t next=0;           // first page not looked at yet
+    for(size_t a=0;a<chunks.size();){
+        const int cy=chunks[a]/gChunksW;
+        size_t b=a;
+        while(b<chunks.size() && chunks[b]/gChunksW==cy) ++b;
+        for(int y=cy*CHUNK; y<std::min(gHeight,cy*CHUNK+CHUNK); ++y)
+            for(size_t c=a;c<b;++c){
+                const int x0=(chunks[c]%gChunksW)*CHUNK, x1=std::min(gWidth,x0+CHUNK)-1;
+                for(size_t p=std::max(next,(size_t)idx(x0,y)/per); p<=(size_t)idx(x1,y)/per; ++p){
+                    if(cells_unused(p*per, cells(p))){
+                        if(run1!=p){ flush(); run0=p; }
+                        run1=p+1;
+                    }
+                    next=p+1;
+                }
+            }
+        a=b;
     }
+    flush();
 }
-static inline bool solid(Element e){
-    switch(e){
-        case Element::STONE: case Element::GLASS: case Element::WALL: case Element::WOOD:
-        case Element::PLANT: case Element::METAL: case Element::WIRE: case Element::ICE:
-        case Element::COAL: case Element::DIRT: case Element::WET_DIRT: case Element::SEAWEED:
-            return true;
-        default: return false;
+
+static void release_chunks(const std::vector<int>& chunks){
+    if(chunks.empty()) return;
+    release_pages(gType,chunks);
+    release_pages(gLife,chunks);
+    release_pages(gStamp,chunks);
+    release_pages(gRest,chunks);
+}
+
+// next tick's rects become current; anything untouched from here on sleeps
+static void begin_chunk_tick(){
+    gDirtyCur.swap(gDirtyNext);
+    for(DirtyRect& r : gDirtyNext) r.clear();
+    if(!gSleepChunks) wake_all();
+    static std::vector<int> done;
+    done.clear();
+    for(size_t k=0;k<gDirtyCur.size();++k){
+        if(!gDirtyCur[k].empty()) gChunkBacked[k]=1;
+        else if(gChunkBacked[k] && !gChunkUsed[k].load(std::memory_order_relaxed)){
+            gChunkBacked[k]=0;
+            done.push_back((int)k);
+        }
     }
+    release_chunks(done);
 }
-static inline bool gas(Element e){
+
+// ===== Particles =====
+// Gases, fire and lightning count their life down every tick and then vanish.
+// Each chunk keeps a CHUNK-bit mask per row of the cells holding one, and a
+// count, both kept in step by the world setters below. step_sim updates these
+// cells from the masks and the sweep skips them, so a smoke cloud costs per
+// particle rather than per cell of the area it covers. Masks are atomic
+// because two chunks in the same parallel phase may both reach into a
+// neighbour's row.
+static_assert(CHUNK==32, "particle rows are 32-bit masks");
+
+static Plane<std::atomic<uint32_t>> gParticleRows;   // [chunk*CHUNK + y%CHUNK]
+static Plane<std::atomic<int>>      gParticleCount;  // [chunk]
+
+static constexpr bool short_lived(Element e){
     switch(e){
-        case Element::SMOKE: case Element::STEAM: case Element::GAS:
-        case Element::TOXIC_GAS: case Element::HYDROGEN: case Element::CHLORINE:
-            return true;
-        default: return false;
+    case Element::SMOKE: case Element::STEAM: case Element::GAS: case Element::TOXIC_GAS:
+    case Element::HYDROGEN: case Element::CHLORINE: case Element::FIRE: case Element::LIGHTNING:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static inline void mark_particle(int x,int y, bool on){
+    const int k=(y/CHUNK)*gChunksW + x/CHUNK;
+    std::atomic<uint32_t>& row=gParticleRows[(size_t)k*CHUNK + y%CHUNK];
+    const uint32_t bit=1u<<(x%CHUNK);
+    if(on){
+        row.fetch_or(bit,std::memory_order_relaxed);
+        gParticleCount[k].fetch_add(1,std::memory_order_relaxed);
+    }else{
+        row.fetch_and(~bit,std::memory_order_relaxed);
+        gParticleCount[k].fetch_sub(1,std::memory_order_relaxed);
     }
 }
-static inline bool flammable(Element e){
-    return e==Element::WOOD || e==Element::PLANT || e==Element::OIL ||
-           e==Element::ETHANOL || e==Element::GUNPOWDER || e==Element::COAL ||
-           e==Element::SEAWEED;
+
+// a particle moved from (ax,ay) to (bx,by), whose old occupant went the other
+// way; within one chunk row that is a single flip of both bits
+static inline void move_particle(int ax,int ay, int bx,int by){
+    const int ka=(ay/CHUNK)*gChunksW + ax/CHUNK, kb=(by/CHUNK)*gChunksW + bx/CHUNK;
+    if(ka!=kb || ay!=by){
+        mark_particle(ax,ay,false);
+        mark_particle(bx,by,true);
+        return;
+    }
+    gParticleRows[(size_t)ka*CHUNK + ay%CHUNK].fetch_xor((1u<<(ax%CHUNK)) | (1u<<(bx%CHUNK)), std::memory_order_relaxed);
 }
-static inline bool conductor(Element e){
-    return e==Element::METAL || e==Element::WIRE || e==Element::MERCURY || e==Element::SALTWATER;
+
+// bits for row y of chunk column x/CHUNK, shifted so bit 0 is cell x
+static inline uint32_t particles_from(int x,int y){
+    const int k=(y/CHUNK)*gChunksW + x/CHUNK;
+    return gParticleRows[(size_t)k*CHUNK + y%CHUNK].load(std::memory_order_relaxed) >> (x%CHUNK);
 }
-static inline bool dissolvable(Element e){
-    return e==Element::SAND || e==Element::STONE || e==Element::GLASS ||
-           e==Element::WOOD || e==Element::PLANT || e==Element::METAL ||
-           e==Element::WIRE || e==Element::ASH || e==Element::COAL ||
-           e==Element::SEAWEED || e==Element::DIRT || e==Element::WET_DIRT;
+
+static void rebuild_particles(){
+    const size_t chunks=(size_t)gChunksW*gChunksH;
+    gParticleRows.reset(chunks*CHUNK);
+    gParticleCount.reset(chunks);
+    for_used_cells([](int x,int y){
+        if(short_lived(gType[idx(x,y)])) mark_particle(x,y,true);
+    });
 }
-// relative density for liquids
-static inline int density(Element e){
-    switch(e){
-        case Element::ETHANOL: return 85;
-        case Element::OIL:     return 90;
-        case Element::GAS: case Element::HYDROGEN: return 1;
-        case Element::STEAM:   return 2;
-        case Element::SMOKE:   return 3;
-        case Element::CHLORINE:return 5;
-        case Element::WATER:   return 100;
-        case Element::SALTWATER:return 103;
-        case Element::ACID:    return 110;
-        case Element::LAVA:    return 160;
-        case Element::MERCURY: return 200;
-        default: return 999;
+
+// ===== Actor buckets =====
+// Live count of humans and zombies per ABUCKET x ABUCKET block, kept in step
+// by the world setters below. find_actor() uses it to skip blocks with no
+// target instead of reading every cell of its 13x13 window. Buckets never
+// straddle a chunk, so parallel chunks never share one.
+static constexpr int ABUCKET = 4;
+static_assert(CHUNK % ABUCKET == 0, "actor buckets must tile chunks");
+
+static int gBucketsW = 0, gBucketsH = 0;
+static Plane<uint8_t> gHumanCount, gZombieCount;
+
+static inline bool is_actor(Element e){ return e==Element::HUMAN || e==Element::ZOMBIE; }
+static inline int bucket_of(int x,int y){ return (y/ABUCKET)*gBucketsW + x/ABUCKET; }
+static inline void count_actor(Element e, int b, int d){
+    if(e==Element::HUMAN) gHumanCount[b]+=d;
+    else if(e==Element::ZOMBIE) gZombieCount[b]+=d;
+}
+
+static void rebuild_actor_buckets(){
+    gBucketsW=(gWidth+ABUCKET-1)/ABUCKET;
+    gBucketsH=(gHeight+ABUCKET-1)/ABUCKET;
+    gHumanCount.reset((size_t)gBucketsW*gBucketsH);
+    gZombieCount.reset((size_t)gBucketsW*gBucketsH);
+    for_used_cells([](int x,int y){ count_actor(gType[idx(x,y)], bucket_of(x,y), 1); });
+}
+
+// All world writes go through these so the chunk rects, particle masks and
+// actor buckets see every change.
+static inline void set_cell(int i, Element t, int life){
+    if(gType[i]==t && gLife[i]==life) return;
+    int y=i/gWidth, x=i-y*gWidth;
+    if(gType[i]!=t && (is_actor(gType[i]) || is_actor(t))){
+        int b=bucket_of(x,y);
+        count_actor(gType[i],b,-1);
+        count_actor(t,b,1);
     }
+    if(gType[i]!=t){
+        wake_changed(x,y);
+        if((gType[i]==Element::EMPTY)!=(t==Element::EMPTY)) count_used(x,y, t==Element::EMPTY ? -1 : 1);
+        gRest[i]=0;
+        if(short_lived(gType[i])!=short_lived(t)) mark_particle(x,y,short_lived(t));
+    }else{
+        wake(x,y);
+    }
+    gType[i]=t; gLife[i]=life;
+}
+static inline void set_life(int i, int life){
+    if(gLife[i]==life) return;
+    gLife[i]=life;
+    wake_index(i);
+}
+// Particles are visited from their masks every tick whatever the chunk rects
+// say, so counting their life down needs no wake; moving or changing does.
+static inline void age_particle(int i){ --gLife[i]; }
+static inline void swap_cells(int a,int b){
+    if(gType[a]==gType[b] && gLife[a]==gLife[b]) return;
+    int ay=a/gWidth, ax=a-ay*gWidth;
+    int by=b/gWidth, bx=b-by*gWidth;
+    if(gType[a]!=gType[b] && (is_actor(gType[a]) || is_actor(gType[b]))){
+        int ba=bucket_of(ax,ay), bb=bucket_of(bx,by);
+        if(ba!=bb){
+            count_actor(gType[a],ba,-1); count_actor(gType[a],bb,1);
+            count_actor(gType[b],bb,-1); count_actor(gType[b],ba,1);
+        }
+    }
+    if(gType[a]!=gType[b]){
+        wake_changed(ax,ay);
+        wake_changed(bx,by);
+        if((gType[a]==Element::EMPTY)!=(gType[b]==Element::EMPTY) && chunk_of(ax,ay)!=chunk_of(bx,by)){
+            count_used(ax,ay, gType[a]==Element::EMPTY ? 1 : -1);
+            count_used(bx,by, gType[b]==Element::EMPTY ? 1 : -1);
+        }
+        if(short_lived(gType[a])!=short_lived(gType[b])){
+            if(short_lived(gType[a])) move_particle(ax,ay,bx,by);
+            else move_particle(bx,by,ax,ay);
+        }
+    }else{
+        wake(ax,ay);
+        wake(bx,by);
+    }
+    std::swap(gType[a],gType[b]);
+    std::swap(gLife[a],gLife[b]);
+    std::swap(gRest[a],gRest[b]);
 }
 
-// harmful stuff for humans/zombies
-static inline bool is_hazard(Element e){
-    return e==Element::FIRE || e==Element::LAVA || e==Element::ACID ||
-           e==Element::TOXIC_GAS || e==Element::CHLORINE || e==Element::LIGHTNING;
+// First `target` in the 13x13 window around (x,y) in row-major order, i.e.
+// exactly what a brute-force scan finds, but only bucket rows and buckets
+// whose count says a target is there get read.
+static bool find_actor(int x,int y, Element target, int& fx,int& fy){
+    const Plane<uint8_t>& count = (target==Element::HUMAN) ? gHumanCount : gZombieCount;
+    const int x0=std::max(0,x-6), x1=std::min(gWidth-1,x+6);
+    const int y0=std::max(0,y-6), y1=std::min(gHeight-1,y+6);
+    int live[13/ABUCKET+2];
+    for(int by=y0/ABUCKET; by<=y1/ABUCKET; ++by){
+        int n=0;
+        for(int bx=x0/ABUCKET; bx<=x1/ABUCKET; ++bx)
+            if(count[by*gBucketsW+bx]) live[n++]=bx;
+        if(!n) continue;
+        const int ry0=std::max(y0,by*ABUCKET), ry1=std::min(y1,by*ABUCKET+ABUCKET-1);
+        for(int yy=ry0; yy<=ry1; ++yy){
+            const int row=yy*gWidth;
+            for(int j=0;j<n;++j){
+                const int sx0=std::max(x0,live[j]*ABUCKET), sx1=std::min(x1,live[j]*ABUCKET+ABUCKET-1);
+                for(int xx=sx0; xx<=sx1; ++xx)
+                    if(gType[row+xx]==target){ fx=xx; fy=yy; return true; }
+            }
+        }
+    }
+    return false;
 }
 
-static inline std::string name_of(Element e){
-    switch(e){
-        case Element::EMPTY: return "Empty";
-        case Element::SAND: return "Sand";
-        case Element::GUNPOWDER: return "Gunpowder";
-        case Element::ASH: return "Ash";
-        case Element::SNOW: return "Snow";
-        case Element::WATER: return "Water";
-        case Element::SALTWATER: return "Salt Water";
-        case Element::OIL: return "Oil";
-        case Element::ETHANOL: return "Ethanol";
-        case Element::ACID: return "Acid";
-        case Element::LAVA: return "Lava";
-        case Element::MERCURY: return "Mercury";
-        case Element::STONE: return "Stone";
-        case Element::GLASS: return "Glass";
-        case Element::WALL: return "Wall";
-        case Element::WOOD: return "Wood";
-        case Element::PLANT: return "Plant";
-        case Element::METAL: return "Metal";
-        case Element::WIRE: return "Wire";
-        case Element::ICE: return "Ice";
-        case Element::COAL: return "Coal";
-        case Element::DIRT: return "Dirt";
-        case Element::WET_DIRT: return "Wet Dirt";
-        case Element::SEAWEED: return "Seaweed";
-        case Element::SMOKE: return "Smoke";
-        case Element::STEAM: return "Steam";
-        case Element::GAS: return "Gas";
-        case Element::TOXIC_GAS: return "Toxic Gas";
-        case Element::HYDROGEN: return "Hydrogen";
-        case Element::CHLORINE: return "Chlorine";
-        case Element::FIRE: return "Fire";
-        case Element::LIGHTNING: return "Lightning";
-        case Element::HUMAN: return "Human";
-        case Element::ZOMBIE: return "Zombie";
+// ===== RNG =====
+// PCG32: 64-bit LCG state with a permuted 32-bit output. The stream id picks
+// one of 2^63 independent sequences for the same seed, so chunks can each
+// own a generator (see sweep_chunk).
+struct Rng {
+    uint64_t state = 0, inc = 1;
+
+    Rng() = default;
+    Rng(uint64_t s, uint64_t stream){ reseed(s,stream); }
+
+    void reseed(uint64_t s, uint64_t stream){
+        state=0; inc=(stream<<1)|1u;
+        next(); state+=s; next();
     }
-    return "?";
+    inline uint32_t next(){
+        uint64_t old=state;
+        state = old*6364136223846793005ULL + inc;
+        uint32_t xorshifted = (uint32_t)(((old>>18)^old)>>27);
+        uint32_t rot = (uint32_t)(old>>59);
+        return (xorshifted>>rot) | (xorshifted<<((32-rot)&31));
+    }
+    // uniform in [0,n) via multiply-shift (no division, no rejection loop)
+    inline uint32_t below(uint32_t n){ return (uint32_t)(((uint64_t)next()*n)>>32); }
+};
+
+static uint64_t gSeed =
+    (uint64_t)std::chrono::high_resolution_clock::now().time_since_epoch().count();
+// Per thread so parallel chunks can each run their own stream.
+static thread_local Rng rng(gSeed, 0);
+
+// p-in-100 as a 32-bit threshold; folds to a constant for literal p
+static constexpr uint32_t chance_threshold(int p){
+    return (uint32_t)(((uint64_t)p<<32)/100);
 }
 
-static inline short color_of(Element e){
-    switch(e){
-        case Element::EMPTY: return 1;
-        // yellow-ish
-        case Element::SAND:
-        case Element::GUNPOWDER:
-        case Element::SNOW:
-        case Element::DIRT:
-            return 2;
-        // cyan water-ish
-        case Element::WATER:
-        case Element::SALTWATER:
-        case Element::STEAM:
-        case Element::ICE:
-        case Element::ETHANOL:
-            return 3;
-        // white solids
-        case Element::STONE:
-        case Element::GLASS:
-        case Element::WALL:
-        case Element::METAL:
-        case Element::WIRE:
-        case Element::COAL:
-        case Element::WET_DIRT:
-            return 4;
-        // green stuff & humans
-        case Element::WOOD:
-        case Element::PLANT:
-        case Element::SEAWEED:
-        case Element::HUMAN:
-            return 5;
-        // red danger
-        case Element::FIRE:
-        case Element::LAVA:
-        case Element::ZOMBIE:
-            return 6;
-        // magenta haze
-        case Element::SMOKE:
-        case Element::ASH:
-        case Element::GAS:
-        case Element::HYDROGEN:
-            return 7;
-        // blue heavy liquids
-        case Element::OIL:
-        case Element::MERCURY:
-            return 8;
-        // green/yellow chem/bolt
-        case Element::ACID:
-        case Element::TOXIC_GAS:
-        case Element::CHLORINE:
-        case Element::LIGHTNING:
-            return 9;
-    }
-    return 1;
-}
-
-static inline char glyph_of(Element e){
-    switch(e){
-        case Element::EMPTY: return ' ';
-        case Element::SAND: return '.';
-        case Element::GUNPOWDER: return '%';
-        case Element::ASH: return ';';
-        case Element::SNOW: return ',';
-        case Element::WATER: return '~';
-        case Element::SALTWATER: return ':';
-        case Element::OIL: return 'o';
-        case Element::ETHANOL: return 'e';
-        case Element::ACID: return 'a';
-        case Element::LAVA: return 'L';
-        case Element::MERCURY: return 'm';
-        case Element::STONE: return '#';
-        case Element::GLASS: return '=';
-        case Element::WALL: return '@';
-        case Element::WOOD: return 'w';
-        case Element::PLANT: return 'p';
-        case Element::SEAWEED: return 'v';
-        case Element::METAL: return 'M';
-        case Element::WIRE: return '-';
-        case Element::ICE: return 'I';
-        case Element::COAL: return 'c';
-        case Element::DIRT: return 'd';
-        case Element::WET_DIRT: return 'D';
-        case Element::SMOKE: return '^';
-        case Element::STEAM: return '"';
-        case Element::GAS: return '`';
-        case Element::TOXIC_GAS: return 'x';
-        case Element::HYDROGEN: return '\'';
-        case Element::CHLORINE: return 'X';
-        case Element::FIRE: return '*';
-        case Element::LIGHTNING: return '|'; // bolt segment
-        case Element::HUMAN: return 'Y';     // stick-ish guy
-        case Element::ZOMBIE: return 'T';    // angry stick
-    }
-    return '?';
+static inline bool in_bounds(int x, int y){ return x>=0 && x<gWidth && y>=0 && y<gHeight; }
+static inline int  rint(int a,int b){ return a + (int)rng.below((uint32_t)(b-a+1)); }
+static inline bool chance(int p){ return p>=100 || rng.next() < chance_threshold(p); }
+static inline bool empty(Element e){ return e==Element::EMPTY; }
+
+// ===== Element properties =====
+// One compile-time row per element, indexed by the enum value. The
+// classification helpers below are a single load plus a mask test.
+enum ElementFlag : uint16_t {
+    F_POWDER      = 1<<0,
+    F_LIQUID      = 1<<1,
+    F_SOLID       = 1<<2,
+    F_GAS         = 1<<3,
+    F_FLAMMABLE   = 1<<4,
+    F_CONDUCTOR   = 1<<5,
+    F_DISSOLVABLE = 1<<6,
+    F_HAZARD      = 1<<7,   // kills humans, burns zombies
+    F_WATERY      = 1<<8,   // water / salt water: can carry a charge pulse
+    F_BLASTPROOF  = 1<<9,   // survives explode()
+};
+
+struct ElementInfo {
+    Element     e;
+    uint16_t    flags;
+    int16_t     density;    // relative; liquids sink through lighter liquids
+    uint8_t     flow;       // liquids: how far sideways they look for a drop each tick
+    char        glyph;
+    uint8_t     color;      // ncurses colour pair
+    int16_t     life;       // initial life when placed
+    const char* name;
+};
+
+static constexpr ElementInfo ELEMENTS[] = {
+    {Element::EMPTY,     0,                                   999, 0, ' ',  1,  0, "Empty"},
+    // powders
+    {Element::SAND,      F_POWDER|F_DISSOLVABLE,              999, 0, '.',  2,  0, "Sand"},
+    {Element::GUNPOWDER, F_POWDER|F_FLAMMABLE,                999, 0, '%',  2,  0, "Gunpowder"},
+    {Element::ASH,       F_POWDER|F_DISSOLVABLE,              999, 0, ';',  7,  0, "Ash"},
+    {Element::SNOW,      F_POWDER,                            999, 0, ',',  2,  0, "Snow"},
+    // liquids
+    {Element::WATER,     F_LIQUID|F_WATERY,                   100, 5, '~',  3,  0, "Water"},
+    {Element::SALTWATER, F_LIQUID|F_WATERY|F_CONDUCTOR,       103, 5, ':',  3,  0, "Salt Water"},
+    {Element::OIL,       F_LIQUID|F_FLAMMABLE,                 90, 4, 'o',  8,  0, "Oil"},
+    {Element::ETHANOL,   F_LIQUID|F_FLAMMABLE,                 85, 5, 'e',  3,  0, "Ethanol"},
+    {Element::ACID,      F_LIQUID|F_HAZARD,                   110, 4, 'a',  9,  0, "Acid"},
+    {Element::LAVA,      F_LIQUID|F_HAZARD,                   160, 1, 'L',  6,  0, "Lava"},
+    {Element::MERCURY,   F_LIQUID|F_CONDUCTOR,                200, 3, 'm',  8,  0, "Mercury"},
+    // solids / terrain
+    {Element::STONE,     F_SOLID|F_DISSOLVABLE|F_BLASTPROOF,  999, 0, '#',  4,  0, "Stone"},
+    {Element::GLASS,     F_SOLID|F_DISSOLVABLE|F_BLASTPROOF,  999, 0, '=',  4,  0, "Glass"},
+    {Element::WALL,      F_SOLID|F_BLASTPROOF,                999, 0, '@',  4,  0, "Wall"},
+    {Element::WOOD,      F_SOLID|F_FLAMMABLE|F_DISSOLVABLE,   999, 0, 'w',  5,  0, "Wood"},
+    {Element::PLANT,     F_SOLID|F_FLAMMABLE|F_DISSOLVABLE,   999, 0, 'p',  5,  0, "Plant"},
+    {Element::METAL,     F_SOLID|F_CONDUCTOR|F_DISSOLVABLE|F_BLASTPROOF, 999, 0, 'M', 4, 0, "Metal"},
+    {Element::WIRE,      F_SOLID|F_CONDUCTOR|F_DISSOLVABLE|F_BLASTPROOF, 999, 0, '-', 4, 0, "Wire"},
+    {Element::ICE,       F_SOLID|F_BLASTPROOF,                999, 0, 'I',  3,  0, "Ice"},
+    {Element::COAL,      F_SOLID|F_FLAMMABLE|F_DISSOLVABLE,   999, 0, 'c',  4,  0, "Coal"},
+    {Element::DIRT,      F_SOLID|F_DISSOLVABLE,               999, 0, 'd',  2,  0, "Dirt"},
+    {Element::WET_DIRT,  F_SOLID|F_DISSOLVABLE,               999, 0, 'D',  4,  0, "Wet Dirt"},
+    {Element::SEAWEED,   F_SOLID|F_FLAMMABLE|F_DISSOLVABLE,   999, 0, 'v',  5,  0, "Seaweed"},
+    // gases
+    {Element::SMOKE,     F_GAS,                                 3, 0, '^',  7, 25, "Smoke"},
+    {Element::STEAM,     F_GAS,                                 2, 0, '"',  3, 25, "Steam"},
+    {Element::GAS,       F_GAS,                                 1, 0, '`',  7, 25, "Gas"},
+    {Element::TOXIC_GAS, F_GAS|F_HAZARD,                      999, 0, 'x',  9, 25, "Toxic Gas"},
+    {Element::HYDROGEN,  F_GAS,                                 1, 0, '\'', 7, 25, "Hydrogen"},
+    {Element::CHLORINE,  F_GAS|F_HAZARD,                        5, 0, 'X',  9, 25, "Chlorine"},
+    // actors / special
+    {Element::FIRE,      F_HAZARD,                            999, 0, '*',  6, 20, "Fire"},
+    {Element::LIGHTNING, F_HAZARD,                            999, 0, '|',  9,  2, "Lightning"}, // bolt segment
+    {Element::HUMAN,     0,                                   999, 0, 'Y',  5,  0, "Human"},     // stick-ish guy
+    {Element::ZOMBIE,    0,                                   999, 0, 'T',  6,  0, "Zombie"},    // angry stick
+};
+static constexpr int ELEMENT_COUNT = (int)(sizeof(ELEMENTS)/sizeof(ELEMENTS[0]));
+
+static constexpr bool elements_in_order(){
+    for(int i=0;i<ELEMENT_COUNT;++i) if((int)ELEMENTS[i].e!=i) return false;
+    return true;
+}
+static_assert(elements_in_order(), "ELEMENTS must list every Element in enum order");
+static_assert(ELEMENT_COUNT==(int)Element::ZOMBIE+1, "ELEMENTS is missing an entry");
+static constexpr bool flows_in_reach(){
+    for(const ElementInfo& i : ELEMENTS) if(i.flow>MAX_FLOW) return false;
+    return true;
+}
+static_assert(flows_in_reach(), "an element's flow exceeds MAX_FLOW");
+
+static constexpr const ElementInfo& info(Element e){ return ELEMENTS[(int)e]; }
+static constexpr bool has(Element e, uint16_t f){ return (info(e).flags & f)!=0; }
+
+// classification helpers
+static constexpr bool sandlike(Element e){ return has(e,F_POWDER); }
+static constexpr bool liquid(Element e){ return has(e,F_LIQUID); }
+static constexpr bool solid(Element e){ return has(e,F_SOLID); }
+static constexpr bool gas(Element e){ return has(e,F_GAS); }
+static constexpr bool flammable(Element e){ return has(e,F_FLAMMABLE); }
+static constexpr bool conductor(Element e){ return has(e,F_CONDUCTOR); }
+static constexpr bool dissolvable(Element e){ return has(e,F_DISSOLVABLE); }
+static constexpr bool is_hazard(Element e){ return has(e,F_HAZARD); }
+static constexpr bool watery(Element e){ return has(e,F_WATERY); }
+static constexpr int  density(Element e){ return info(e).density; }
+
+static constexpr bool gases_short_lived(){
+    for(int i=0;i<ELEMENT_COUNT;++i) if(gas((Element)i) && !short_lived((Element)i)) return false;
+    return true;
 }
+static_assert(gases_short_lived(), "every gas must be in short_lived()");
+
+// hazard or electrified water: what kills humans and burns zombies
+static inline bool harms_actors(int i){
+    uint16_t f=info(gType[i]).flags;
+    return (f & F_HAZARD) || ((f & F_WATERY) && gLife[i]>0);
+}
+
+static inline const char* name_of(Element e){ return info(e).name; }
+static inline short color_of(Element e){ return info(e).color; }
+static inline char  glyph_of(Element e){ return info(e).glyph; }
 
 // ===== Grid =====
 static void init_grid(int w,int h){
     gWidth=w; gHeight=h;
-    grid.assign(gHeight, std::vector<Cell>(gWidth));
+    gType.reset((size_t)gWidth*gHeight);
+    gLife.reset((size_t)gWidth*gHeight);
+    gStamp.reset((size_t)gWidth*gHeight);
+    gRest.reset((size_t)gWidth*gHeight);
+    gTick=0;
+    init_chunks();
+    rebuild_particles();
+    rebuild_actor_buckets();
 }
 static void clear_grid(){
-    for(int y=0;y<gHeight;++y)
-        for(int x=0;x<gWidth;++x)
-            grid[y][x]=Cell{};
+    gType.zero();
+    gLife.zero();
+    gStamp.zero();
+    gRest.zero();
+    gChunkUsed.zero();
+    gChunkBacked.zero();
+    rebuild_particles();
+    rebuild_actor_buckets();
+    // an empty world has nothing to sweep, so every chunk goes to sleep
+    for(DirtyRect& r : gDirtyCur) r.clear();
+    for(DirtyRect& r : gDirtyNext) r.clear();
+}
+
+// ===== Tracing =====
+// TRACE_SCOPE("name") records how long the enclosing block took as a Chrome
+// trace "complete" event; TRACE_COUNTER adds a counter sample. Events go into
+// a ring buffer allocated once by trace_begin (the oldest are overwritten when
+// it fills), and write_trace dumps them as trace-event JSON that
+// chrome://tracing or ui.perfetto.dev can open. Build with -DPOWDER_TRACE=0
+// to compile every scope out, or -DPOWDER_TRACE=2 to also trace each cell
+// update by element (slow; it shows which elements' rules dominate a sweep).
+#ifndef POWDER_TRACE
+#define POWDER_TRACE 1
+#endif
+
+#if POWDER_TRACE
+struct TraceEvent {
+    const char* name;
+    uint64_t ts;      // ns since trace_begin
+    int64_t  value;   // duration in ns, or the counter value
+    uint32_t tid;
+    char     ph;      // 'X' complete event, 'C' counter
+};
+
+static constexpr size_t TRACE_RING = size_t(1)<<20;   // power of two
+static bool gTraceOn = false;
+static std::vector<TraceEvent> gTraceRing;
+static std::atomic<uint64_t> gTraceHead{0};
+static std::atomic<uint32_t> gTraceThreads{0};
+static std::chrono::steady_clock::time_point gTraceEpoch;
+
+static inline uint64_t trace_now(){
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now()-gTraceEpoch).count();
 }
 
-// ===== Helpers =====
+static inline uint32_t trace_tid(){
+    static thread_local uint32_t tid = gTraceThreads.fetch_add(1)+1;
+    return tid;
+}
+
+static inline void trace_emit(const char* name, uint64_t ts, int64_t value, char ph){
+    uint64_t at=gTraceHead.fetch_add(1,std::memory_order_relaxed);
+    gTraceRing[at&(TRACE_RING-1)] = {name,ts,value,trace_tid(),ph};
+}
+
+struct TraceScope {
+    const char* name;
+    uint64_t t0;
+    explicit TraceScope(const char* n) : name(n), t0(gTraceOn ? trace_now() : 0) {}
+    ~TraceScope(){ if(gTraceOn) trace_emit(name,t0,(int64_t)(trace_now()-t0),'X'); }
+};
+
+static void trace_begin(){
+    gTraceRing.assign(TRACE_RING,TraceEvent{});
+    gTraceHead=0;
+    gTraceEpoch=std::chrono::steady_clock::now();
+    gTraceOn=true;
+}
+
+static bool write_trace(const std::string& path, std::string& err){
+    FILE* f=std::fopen(path.c_str(),"w");
+    if(!f){ err="cannot write "+path; return false; }
+    uint64_t head=gTraceHead.load();
+    uint64_t first = head>TRACE_RING ? head-TRACE_RING : 0;
+    std::fprintf(f,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for(uint64_t i=first;i<head;++i){
+        const TraceEvent& e=gTraceRing[i&(TRACE_RING-1)];
+        if(e.ph=='X')
+            std::fprintf(f,"{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f},\n",
+                         e.name, e.tid, e.ts/1000.0, e.value/1000.0);
+        else
+            std::fprintf(f,"{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"args\":{\"n\":%lld}},\n",
+                         e.name, e.tid, e.ts/1000.0, (long long)e.value);
+    }
+    std::fprintf(f,"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"powder\"}}\n]}\n");
+    bool ok = std::fclose(f)==0;
+    if(!ok) err="short write to "+path;
+    return ok;
+}
+
+#define TRACE_CAT_(a,b) a##b
+#define TRACE_CAT(a,b) TRACE_CAT_(a,b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CAT(traceScope_,__LINE__)(name)
+#define TRACE_COUNTER(name,value) do{ if(gTraceOn) trace_emit((name),trace_now(),(int64_t)(value),'C'); }while(0)
+#else
+#define TRACE_SCOPE(name) ((void)0)
+#define TRACE_COUNTER(name,value) ((void)0)
+#endif
+
+#if POWDER_TRACE >= 2
+#define TRACE_CELL(name) TRACE_SCOPE(name)
+#else
+#define TRACE_CELL(name) ((void)0)
+#endif
+
+// ===== Explosions =====
+// explode() only queues a blast. After the sweep, apply_explosions() cuts
+// every queued blast into row spans using a precomputed circular stencil,
+// merges overlapping spans, and rolls each covered cell exactly once, so a
+// spark on a gunpowder field costs one pass over the blast area however many
+// neighbours asked for it.
+static constexpr int MAX_BLAST = 8;
+
+struct BlastStencil {
+    int8_t half[MAX_BLAST+1][2*MAX_BLAST+1];   // half[r][dy+r]: span half-width
+};
+static constexpr BlastStencil make_blast_stencil(){
+    BlastStencil s{};
+    for(int r=0;r<=MAX_BLAST;++r)
+        for(int dy=-r;dy<=r;++dy){
+            int h=0;
+            while((h+1)*(h+1)+dy*dy<=r*r) ++h;
+            s.half[r][dy+r]=(int8_t)h;
+        }
+    return s;
+}
+static constexpr BlastStencil BLAST = make_blast_stencil();
+
+struct Blast { int x, y, r; };
+struct BlastSpan { int y, x0, x1; };
+static std::vector<Blast> gBlastQueue;
+static std::mutex gBlastMutex;
+
 static void explode(int cx,int cy,int r){
-    for(int dy=-r; dy<=r; ++dy){
-        for(int dx=-r; dx<=r; ++dx){
-            int x=cx+dx, y=cy+dy;
-            if(!in_bounds(x,y)) continue;
-            if(dx*dx+dy*dy>r*r) continue;
-            Cell& c=grid[y][x];
-            if(c.type==Element::WALL) continue;
-            if(c.type==Element::STONE||c.type==Element::GLASS||
-               c.type==Element::METAL||c.type==Element::WIRE||
-               c.type==Element::ICE) continue;
+    TRACE_SCOPE("explode");
+    r=std::min(r,MAX_BLAST);
+    std::lock_guard<std::mutex> lk(gBlastMutex);
+    gBlastQueue.push_back({cx,cy,r});
+}
 
+static void apply_explosions(){
+    if(gBlastQueue.empty()) return;
+    TRACE_SCOPE("apply_explosions");
+    TRACE_COUNTER("blasts",gBlastQueue.size());
+    static std::vector<BlastSpan> spans;
+    spans.clear();
+    for(const Blast& b : gBlastQueue)
+        for(int dy=-b.r; dy<=b.r; ++dy){
+            int y=b.y+dy;
+            if(y<0 || y>=gHeight) continue;
+            int h=BLAST.half[b.r][dy+b.r];
+            int x0=std::max(0,b.x-h), x1=std::min(gWidth-1,b.x+h);
+            if(x0<=x1) spans.push_back({y,x0,x1});
+        }
+    gBlastQueue.clear();
+
+    std::sort(spans.begin(),spans.end(),[](const BlastSpan& a,const BlastSpan& b){
+        return a.y!=b.y ? a.y<b.y : a.x0<b.x0;
+    });
+    for(size_t i=0;i<spans.size();){
+        const int y=spans[i].y;
+        int x0=spans[i].x0, x1=spans[i].x1;
+        for(++i; i<spans.size() && spans[i].y==y && spans[i].x0<=x1+1; ++i)
+            x1=std::max(x1,spans[i].x1);
+
+        const int row=y*gWidth;
+        for(int x=x0; x<=x1; ++x){
+            const int c=row+x;
+            if(has(gType[c],F_BLASTPROOF)) continue;
             int roll=rint(1,100);
-            if(roll<=50){ c.type=Element::FIRE; c.life=15+rint(0,10); }
-            else if(roll<=80){ c.type=Element::SMOKE; c.life=20; }
-            else { c.type=Element::GAS; c.life=20; }
+            if(roll<=50){ set_cell(c,Element::FIRE,15+rint(0,10)); }
+            else if(roll<=80){ set_cell(c,Element::SMOKE,20); }
+            else { set_cell(c,Element::GAS,20); }
+        }
+    }
+}
+
+// ===== Charge network =====
+// Optional (--charge-net) replacement for the one-cell-per-tick charge push.
+// Charges raised during a tick are queued and applied after the sweep in one
+// multi-source BFS over the connected conductors (wire/metal, and water which
+// only passes charge on to water), falling off by one per step. A shock
+// then costs O(region) once instead of O(region) every frame it spreads, and
+// the result no longer depends on sweep direction.
+static bool gChargeNet = false;
+
+struct ChargeSource { int i, q; };
+static std::vector<ChargeSource> gChargeQueue;
+static std::mutex gChargeMutex;
+
+static constexpr bool wired(Element e){ return e==Element::WIRE || e==Element::METAL; }
+
+// raise cell i's charge to at least q
+static void charge(int i,int q){
+    if(!gChargeNet){
+        if(gLife[i]<q) set_life(i,q);
+        return;
+    }
+    std::lock_guard<std::mutex> lk(gChargeMutex);
+    gChargeQueue.push_back({i,q});
+}
+
+static void flush_charges(){
+    if(gChargeQueue.empty()) return;
+    TRACE_SCOPE("flush_charges");
+    // Dial's algorithm: bucket cells by charge, expand from the strongest
+    static std::vector<std::vector<int>> level;
+    int top=0;
+    for(const ChargeSource& s : gChargeQueue){
+        Element e=gType[s.i];
+        if(!(wired(e) || watery(e)) || gLife[s.i]>=s.q) continue;
+        set_life(s.i,s.q);
+        if(s.q>=(int)level.size()) level.resize(s.q+1);
+        level[s.q].push_back(s.i);
+        top=std::max(top,s.q);
+    }
+    gChargeQueue.clear();
+
+    for(int q=top; q>=1; --q){
+        for(size_t k=0; k<level[q].size(); ++k){
+            const int i=level[q][k];
+            if(gLife[i]!=q || q==1) continue;   // raised again since, or spent
+            const bool fromWire=wired(gType[i]);
+            const int y=i/gWidth, x=i-y*gWidth;
+            for(int dy=-1;dy<=1;++dy)
+                for(int dx=-1;dx<=1;++dx){
+                    if(!dx && !dy) continue;
+                    int nx=x+dx, ny=y+dy;
+                    if(!in_bounds(nx,ny)) continue;
+                    const int n=idx(nx,ny);
+                    Element ne=gType[n];
+                    if(!(watery(ne) || (fromWire && wired(ne)))) continue;
+                    if(gLife[n]<q-1){
+                        set_life(n,q-1);
+                        level[q-1].push_back(n);
+                    }
+                }
         }
+        level[q].clear();
     }
 }
 
+// ===== Brush =====
+// Discs are laid down a row span at a time: half_width(rad,dy) is how far a
+// disc of radius rad reaches sideways dy rows from its centre.
+static inline int half_width(int rad,int dy){
+    int hw=(int)std::sqrt((double)(rad*rad-dy*dy));
+    while(hw*hw+dy*dy>rad*rad) --hw;
+    while((hw+1)*(hw+1)+dy*dy<=rad*rad) ++hw;
+    return hw;
+}
+static inline void fill_span(int y,int x0,int x1, Element e,int life){
+    if(y<0 || y>=gHeight) return;
+    x0=std::max(0,x0); x1=std::min(gWidth-1,x1);
+    for(int c=idx(x0,y), end=c+(x1-x0); c<=end; ++c) set_cell(c,e,life);
+}
+
 static void place_brush(int cx,int cy,int rad, Element e){
     if(e==Element::LIGHTNING){
         // SPECIAL: lightning is a vertical yellow bolt striking DOWN to first surface
@@ -283,800 +924,1584 @@ static void place_brush(int cx,int cy,int rad, Element e){
         int y=cy;
         // fall through air/gas until hitting non-air or bottom
         while(y+1<gHeight){
-            Element below = grid[y+1][x].type;
-            if(!empty(grid[y+1][x]) && !gas(below)) break;
+            Element below = gType[idx(x,y+1)];
+            if(!empty(below) && !gas(below)) break;
             ++y;
         }
         for(int yy=cy; yy<=y; ++yy){
-            Cell &c=grid[yy][x];
-            c.type=Element::LIGHTNING;
-            c.life=2; // short-lived
+            const int c = idx(x,yy);
+            set_cell(c,Element::LIGHTNING,2); // short-lived
         }
         // if we hit water/saltwater below, electrify it
         if(y+1 < gHeight){
-            Cell &below = grid[y+1][x];
-            if(below.type==Element::WATER || below.type==Element::SALTWATER){
-                below.life = std::max(below.life, 8);
+            const int below = idx(x,y+1);
+            if(watery(gType[below])){
+                charge(below,8);
+                flush_charges();
             }
         }
         return;
     }
 
+    int life = info(e).life;
     for(int dy=-rad; dy<=rad; ++dy){
-        for(int dx=-rad; dx<=rad; ++dx){
-            int x=cx+dx, y=cy+dy;
-            if(!in_bounds(x,y)) continue;
-            if(dx*dx+dy*dy<=rad*rad){
-                Cell &c=grid[y][x];
-                c.type=e;
-                c.life=0;
-                if(gas(e)) c.life=25;
-                if(e==Element::FIRE) c.life=20;
+        const int hw=half_width(rad,dy);
+        fill_span(cy+dy,cx-hw,cx+hw,e,life);
+    }
+}
+
+// The brush dragged from (x0,y0) to (x1,y1): every disc centred on the
+// Bresenham line between them. Their union is one span per row (each row
+// of the stroke is a run of overlapping disc rows), so each cell is set
+// once however long the stroke is. Lightning has no area; it just strikes
+// at the end.
+static void stroke_brush(int x0,int y0,int x1,int y1,int rad, Element e){
+    if(e==Element::LIGHTNING){
+        place_brush(x1,y1,rad,e);
+        return;
+    }
+    const int top=std::min(y0,y1)-rad;
+    std::vector<std::pair<int,int>> spans(std::abs(y1-y0)+2*rad+1, {INT_MAX,INT_MIN});
+    const int dx=std::abs(x1-x0), sx=x0<x1?1:-1;
+    const int dy=-std::abs(y1-y0), sy=y0<y1?1:-1;
+    for(int x=x0,y=y0,err=dx+dy;;){
+        for(int ry=-rad; ry<=rad; ++ry){
+            const int hw=half_width(rad,ry);
+            auto& s=spans[y+ry-top];
+            s.first=std::min(s.first,x-hw);
+            s.second=std::max(s.second,x+hw);
+        }
+        if(x==x1 && y==y1) break;
+        const int e2=2*err;
+        if(e2>=dy){ err+=dy; x+=sx; }
+        if(e2<=dx){ err+=dx; y+=sy; }
+    }
+    const int life=info(e).life;
+    for(size_t i=0;i<spans.size();++i)
+        if(spans[i].first<=spans[i].second) fill_span(top+(int)i,spans[i].first,spans[i].second,e,life);
+}
+
+// Bucket fill: turn the 4-connected region of (x,y)'s element into e.
+// Scanline: each popped seed is widened to the whole run of that element in
+// its row, filled, and the rows above and below get one seed per run they
+// share with it, so the stack stays small and nothing recurses.
+static void flood_fill(int x,int y, Element e){
+    if(!in_bounds(x,y)) return;
+    const Element from=gType[idx(x,y)];
+    if(from==e) return;
+    const int life=info(e).life;
+    std::vector<std::pair<int,int>> seeds{{x,y}};
+    auto seed_runs=[&](int row,int x0,int x1){
+        if(row<0 || row>=gHeight) return;
+        for(int i=x0; i<=x1; ++i){
+            if(gType[idx(i,row)]!=from) continue;
+            seeds.push_back({i,row});
+            while(i<=x1 && gType[idx(i,row)]==from) ++i;
+        }
+    };
+    while(!seeds.empty()){
+        auto [sx,sy]=seeds.back();
+        seeds.pop_back();
+        if(gType[idx(sx,sy)]!=from) continue;   // filled since it was pushed
+        int x0=sx, x1=sx;
+        while(x0>0 && gType[idx(x0-1,sy)]==from) --x0;
+        while(x1<gWidth-1 && gType[idx(x1+1,sy)]==from) ++x1;
+        fill_span(sy,x0,x1,e,life);
+        seed_runs(sy-1,x0,x1);
+        seed_runs(sy+1,x0,x1);
+    }
+}
+
+// ===== Thread pool =====
+// Fixed set of workers that run index-parallel jobs; the calling thread
+// takes part too, so a pool of size N uses N-1 extra threads.
+struct ThreadPool {
+    explicit ThreadPool(int n){
+        for(int i=1;i<n;++i) workers.emplace_back([this]{ worker_loop(); });
+    }
+    ~ThreadPool(){
+        { std::lock_guard<std::mutex> lk(m); quit=true; }
+        wakeCv.notify_all();
+        for(auto& t:workers) t.join();
+    }
+    int size() const { return (int)workers.size()+1; }
+
+    // fn(i) for every i in [0,count); returns once all have finished
+    void run(int count, const std::function<void(int)>& fn){
+        if(workers.empty() || count<=1){
+            for(int i=0;i<count;++i) fn(i);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lk(m);
+            job=&fn; jobCount=count; next.store(0);
+            pending=(int)workers.size();
+            ++generation;
+        }
+        wakeCv.notify_all();
+        drain();
+        std::unique_lock<std::mutex> lk(m);
+        doneCv.wait(lk,[&]{ return pending==0; });
+        job=nullptr;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::mutex m;
+    std::condition_variable wakeCv, doneCv;
+    const std::function<void(int)>* job=nullptr;
+    int jobCount=0, pending=0;
+    std::atomic<int> next{0};
+    uint64_t generation=0;
+    bool quit=false;
+
+    void drain(){
+        for(int i; (i=next.fetch_add(1))<jobCount; ) (*job)(i);
+    }
+    void worker_loop(){
+        uint64_t seen=0;
+        for(;;){
+            {
+                std::unique_lock<std::mutex> lk(m);
+                wakeCv.wait(lk,[&]{ return quit || generation!=seen; });
+                if(quit) return;
+                seen=generation;
             }
+            drain();
+            std::lock_guard<std::mutex> lk(m);
+            if(--pending==0) doneCv.notify_one();
         }
     }
+};
+
+static std::unique_ptr<ThreadPool> gPool;
+
+// ===== Frame stats =====
+// Cheap always-on counters for the perf HUD: how many cells of each broad
+// category were updated last tick, and how long each phase of step_sim took.
+// Workers count into thread-local tallies and add them up once per chunk.
+enum StatCat : uint8_t { S_POWDER, S_LIQUID, S_GAS, S_FIRE, S_ACTOR, S_CONDUCTOR, S_OTHER, STAT_CATS };
+static constexpr const char* STAT_NAMES[STAT_CATS] = {
+    "powder", "liquid", "gas", "fire", "actor", "conduct", "other"
+};
+
+static constexpr StatCat stat_cat(Element e){
+    if(e==Element::FIRE || e==Element::LIGHTNING) return S_FIRE;
+    if(e==Element::HUMAN || e==Element::ZOMBIE) return S_ACTOR;
+    if(gas(e)) return S_GAS;
+    if(liquid(e)) return S_LIQUID;
+    if(sandlike(e)) return S_POWDER;
+    if(conductor(e)) return S_CONDUCTOR;
+    return S_OTHER;
+}
+
+struct StatCatTable {
+    StatCat cat[ELEMENT_COUNT] = {};
+    constexpr StatCatTable(){
+        for(int i=0;i<ELEMENT_COUNT;++i) cat[i]=stat_cat((Element)i);
+    }
+};
+static constexpr StatCatTable STAT_CAT{};
+
+struct TickStats {
+    double sweepMs=0, blastMs=0, chargeMs=0;
+    uint32_t cells[STAT_CATS] = {};
+};
+static TickStats gLastTick;                              // filled by step_sim
+static std::atomic<uint32_t> gCellTally[STAT_CATS];
+static thread_local uint32_t tCellTally[STAT_CATS];
+
+static void flush_cell_tally(){
+    for(int k=0;k<STAT_CATS;++k){
+        if(tCellTally[k]) gCellTally[k].fetch_add(tCellTally[k],std::memory_order_relaxed);
+        tCellTally[k]=0;
+    }
 }
 
 // ===== Simulation =====
-static void step_sim(){
-    if(gWidth<=0||gHeight<=0) return;
-    std::vector<std::vector<bool>> updated(gHeight, std::vector<bool>(gWidth,false));
+// Advance one cell. Everything a cell reads or writes during the sweep lies
+// within SIM_REACH of it (the 13x13 actor scan; explosions and network
+// charge are applied after the sweep), which is what lets step_sim_parallel
+// run far-apart chunks at the same time.
+static constexpr int SIM_REACH = 6;
+
+// Per-element update kernels. Each one is what update_cell used to do for its
+// element once the type was known; the element-class kernels are templates,
+// so a kernel instance has its element's properties (density, flow, which
+// reactions apply) folded in as constants. KERNELS maps every element to its
+// instance and update_cell makes one indirect call through it.
+using Kernel = void(*)(int x,int y,int cell);
+
+// move the cell to (nx,ny), marking it handled there
+static inline void move_to(int cell,int nx,int ny){
+    swap_cells(idx(nx,ny), cell);
+    gStamp[idx(nx,ny)]=gTick;
+}
 
-    for(int y=gHeight-1; y>=0; --y){
-        for(int x=0; x<gWidth; ++x){
-            if(updated[y][x]) continue;
-            Cell &cell = grid[y][x];
-            Element t = cell.type;
-            if(t==Element::EMPTY || t==Element::WALL){
-                updated[y][x]=true;
-                continue;
-            }
+// creatures step into air or gas
+static inline bool walk_try(int cell,int tx,int ty){
+    if(!in_bounds(tx,ty)) return false;
+    const int d = idx(tx,ty);
+    if(empty(gType[d]) || gas(gType[d])){
+        swap_cells(d,cell);
+        return true;
+    }
+    return false;
+}
 
-            auto swap_to = [&](int nx,int ny){
-                std::swap(grid[ny][nx], cell);
-                updated[ny][nx]=true;
-            };
+// stone, glass, dry dirt (and EMPTY/WALL, though update_cell stamps those itself)
+static void update_inert(int,int,int cell){ gStamp[cell]=gTick; }
 
-            // --- powders ---
-            if(sandlike(t)){
-                bool moved=false;
+// --- powders ---
+template<Element T>
+static void update_powder(int x,int y,int cell){
+    bool moved=false;
 
-                if(in_bounds(x,y+1)){
-                    Cell &below=grid[y+1][x];
-                    if(empty(below) || liquid(below.type)){
-                        swap_to(x,y+1);
-                        moved=true;
-                    }
+    if(in_bounds(x,y+1)){
+        const int below = idx(x,y+1);
+        if(empty(gType[below]) || liquid(gType[below])){
+            move_to(cell,x,y+1);
+            moved=true;
+        }
+    }
+    if(!moved){
+        int dir = rint(0,1)?1:-1;
+        for(int i=0;i<2 && !moved;++i){
+            int nx=x+(i?-dir:dir), ny=y+1;
+            if(!in_bounds(nx,ny)) continue;
+            const int d = idx(nx,ny);
+            if(empty(gType[d]) || liquid(gType[d])){
+                move_to(cell,nx,ny);
+                moved=true;
+            }
+        }
+    }
+    if(!moved) gStamp[cell]=gTick;
+
+    // snow melts near heat
+    if constexpr(T==Element::SNOW){
+        for(int dy=-1;dy<=1;++dy)
+            for(int dx=-1;dx<=1;++dx){
+                int nx=x+dx, ny=y+dy;
+                if(!in_bounds(nx,ny)) continue;
+                Element ne=gType[idx(nx,ny)];
+                if(ne==Element::FIRE || ne==Element::LAVA){
+                    set_cell(cell,Element::WATER,0);
                 }
-                if(!moved){
-                    int dir = rint(0,1)?1:-1;
-                    for(int i=0;i<2 && !moved;++i){
-                        int nx=x+(i?-dir:dir), ny=y+1;
-                        if(!in_bounds(nx,ny)) continue;
-                        Cell &d=grid[ny][nx];
-                        if(empty(d) || liquid(d.type)){
-                            swap_to(nx,ny);
-                            moved=true;
+            }
+    }
+
+    // seaweed seed: sand under persistent water, spaced apart
+    if constexpr(T==Element::SAND){
+        if(in_bounds(x,y-1) && gType[idx(x,y-1)]==Element::WATER){
+            set_life(cell,gLife[cell]+1);
+            if(gLife[cell]>220){
+                bool nearbyWeed=false;
+                for(int wy=-2;wy<=2 && !nearbyWeed;++wy){
+                    for(int wx=-2;wx<=2;++wx){
+                        int sx=x+wx, sy=y+wy;
+                        if(!in_bounds(sx,sy)) continue;
+                        if(gType[idx(sx,sy)]==Element::SEAWEED){
+                            nearbyWeed=true;
+                            break;
                         }
                     }
                 }
-                if(!moved) updated[y][x]=true;
-
-                // snow melts near heat
-                if(t==Element::SNOW){
-                    for(int dy=-1;dy<=1;++dy)
-                        for(int dx=-1;dx<=1;++dx){
-                            int nx=x+dx, ny=y+dy;
-                            if(!in_bounds(nx,ny)) continue;
-                            Element ne=grid[ny][nx].type;
-                            if(ne==Element::FIRE || ne==Element::LAVA){
-                                cell.type=Element::WATER;
-                                cell.life=0;
-                            }
-                        }
+                if(!nearbyWeed && in_bounds(x,y-1) && gType[idx(x,y-1)]==Element::WATER){
+                    set_cell(idx(x,y-1),Element::SEAWEED,0);
                 }
+                set_life(cell,0);
+            }
+        }else{
+            set_life(cell,0);
+        }
+    }
+}
 
-                // seaweed seed: sand under persistent water, spaced apart
-                if(t==Element::SAND){
-                    if(in_bounds(x,y-1) && grid[y-1][x].type==Element::WATER){
-                        cell.life++;
-                        if(cell.life>220){
-                            bool nearbyWeed=false;
-                            for(int wy=-2;wy<=2 && !nearbyWeed;++wy){
-                                for(int wx=-2;wx<=2;++wx){
-                                    int sx=x+wx, sy=y+wy;
-                                    if(!in_bounds(sx,sy)) continue;
-                                    if(grid[sy][sx].type==Element::SEAWEED){
-                                        nearbyWeed=true;
-                                        break;
-                                    }
-                                }
-                            }
-                            if(!nearbyWeed && in_bounds(x,y-1) && grid[y-1][x].type==Element::WATER){
-                                grid[y-1][x].type=Element::SEAWEED;
-                                grid[y-1][x].life=0;
-                            }
-                            cell.life=0;
-                        }
-                    }else{
-                        cell.life=0;
-                    }
-                }
+// --- liquids ---
+template<Element T>
+static void update_liquid(int x,int y,int cell){
+    bool moved=false;
+
+    if(in_bounds(x,y+1)){
+        const int b = idx(x,y+1);
+        if(empty(gType[b]) || gas(gType[b])){
+            move_to(cell,x,y+1);
+            moved=true;
+        }else if(liquid(gType[b]) && density(T)>density(gType[b])){
+            move_to(cell,x,y+1);
+            moved=true;
+        }
+    }
 
-                continue;
+    // Sideways: look up to `flow` cells each way along open cells for
+    // the nearest drop and move straight there. Failing that, wander to
+    // the farthest open cell one way or the other, until the cell has
+    // wandered LIQUID_SETTLE ticks without finding a drop; a heavier
+    // liquid swaps sideways only where it can then sink. A settled cell
+    // stays put and lets its chunk sleep.
+    if(moved){
+        gRest[idx(x,y+1)]=0;
+        // landing on liquid puts it under pressure: it may spread again
+        if(in_bounds(x,y+2) && liquid(gType[idx(x,y+2)])) gRest[idx(x,y+2)]=0;
+    }else{
+        auto open=[](Element e){ return empty(e) || gas(e); };
+        int order[2]={-1,1};
+        if(rint(0,1)) std::swap(order[0],order[1]);
+        const int flow=info(T).flow;
+
+        int dropX=-1, dropDist=INT_MAX;
+        for(int d : order)
+            for(int k=1; k<=flow && k<dropDist; ++k){
+                int nx=x+d*k;
+                if(!in_bounds(nx,y) || !open(gType[idx(nx,y)])) break;
+                if(in_bounds(nx,y+1) && open(gType[idx(nx,y+1)])){
+                    dropX=nx; dropDist=k;
+                    break;
+                }
             }
+        if(dropX>=0){
+            move_to(cell,dropX,y);
+            gRest[idx(dropX,y)]=0;
+            moved=true;
+        }
 
-            // --- liquids ---
-            if(liquid(t)){
-                bool moved=false;
-
-                if(in_bounds(x,y+1)){
-                    Cell &b=grid[y+1][x];
-                    if(empty(b) || gas(b.type)){
-                        swap_to(x,y+1);
-                        moved=true;
-                    }else if(liquid(b.type) && density(t)>density(b.type)){
-                        swap_to(x,y+1);
+        for(int i=0;i<2 && !moved;++i){
+            int d=order[i], nx=x+d;
+            if(!in_bounds(nx,y)) continue;
+            const Element s = gType[idx(nx,y)];
+            if(open(s)){
+                if(gRest[cell]>=LIQUID_SETTLE) continue;
+                int to=nx;
+                for(int k=2; k<=flow && in_bounds(x+d*k,y) && open(gType[idx(x+d*k,y)]); ++k) to=x+d*k;
+                move_to(cell,to,y);
+                ++gRest[idx(to,y)];
+                moved=true;
+            }else if(liquid(s) && density(T)>density(s) && in_bounds(nx,y+1)){
+                const Element u = gType[idx(nx,y+1)];
+                if(open(u) || (liquid(u) && density(T)>density(u))){
+                    if(chance(50)){
+                        move_to(cell,nx,y);
                         moved=true;
+                    }else{
+                        wake(x,y); // still unsettled; keep the chunk awake
                     }
                 }
+            }
+        }
+    }
 
-                if(!moved){
-                    int order[2]={-1,1};
-                    if(rint(0,1)) std::swap(order[0],order[1]);
-                    for(int i=0;i<2 && !moved;++i){
-                        int nx=x+order[i];
-                        if(!in_bounds(nx,y)) continue;
-                        Cell &s=grid[y][nx];
-                        if(empty(s) || gas(s.type)){
-                            swap_to(nx,y);
-                            moved=true;
-                        }else if(liquid(s.type) && density(t)>density(s.type) && chance(50)){
-                            swap_to(nx,y);
-                            moved=true;
-                        }
+    if(!moved) gStamp[cell]=gTick;
+
+    // interactions
+    for(int dy=-1;dy<=1;++dy){
+        for(int dx=-1;dx<=1;++dx){
+            if(!dx && !dy) continue;
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            const int n = idx(nx,ny);
+
+            // water vs fire/lava
+            if constexpr(watery(T)){
+                if(gType[n]==Element::FIRE){
+                    set_cell(n,Element::SMOKE,15);
+                }else if(gType[n]==Element::LAVA){
+                    set_cell(n,Element::STONE,0);
+                    // sometimes big steam, sometimes fully cooled
+                    if(chance(50)){
+                        set_cell(cell,Element::STEAM,20);
+                    }else{
+                        set_cell(cell,Element::STONE,0);
                     }
                 }
+            }
 
-                if(!moved) updated[y][x]=true;
-
-                // interactions
-                for(int dy=-1;dy<=1;++dy){
-                    for(int dx=-1;dx<=1;++dx){
-                        if(!dx && !dy) continue;
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        Cell &n=grid[ny][nx];
-
-                        // water vs fire/lava
-                        if(t==Element::WATER || t==Element::SALTWATER){
-                            if(n.type==Element::FIRE){
-                                n.type=Element::SMOKE;
-                                n.life=15;
-                            }else if(n.type==Element::LAVA){
-                                n.type=Element::STONE;
-                                n.life=0;
-                                // sometimes big steam, sometimes fully cooled
-                                if(chance(50)){
-                                    cell.type=Element::STEAM;
-                                    cell.life=20;
-                                }else{
-                                    cell.type=Element::STONE;
-                                    cell.life=0;
-                                }
-                            }
-                        }
-
-                        // oil/ethanol ignite
-                        if(t==Element::OIL || t==Element::ETHANOL){
-                            if(n.type==Element::FIRE || n.type==Element::LAVA){
-                                cell.type=Element::FIRE;
-                                cell.life=25;
-                            }
-                        }
-
-                        // acid eats stuff
-                        if(t==Element::ACID){
-                            if(dissolvable(n.type)){
-                                if(chance(30)){
-                                    n.type=Element::TOXIC_GAS;
-                                    n.life=25;
-                                }else{
-                                    n.type=Element::EMPTY;
-                                    n.life=0;
-                                }
-                                if(chance(25)){
-                                    cell.type=Element::EMPTY;
-                                    cell.life=0;
-                                }
-                            }
-                            if(n.type==Element::WATER && chance(30)){
-                                cell.type=Element::SALTWATER;
-                                cell.life=0;
-                                if(chance(30)){
-                                    n.type=Element::STEAM;
-                                    n.life=20;
-                                }
-                            }
-                        }
-
-                        // lava
-                        if(t==Element::LAVA){
-                            if(flammable(n.type)){
-                                n.type=Element::FIRE;
-                                n.life=25;
-                            }else if(n.type==Element::SAND || n.type==Element::SNOW){
-                                n.type=Element::GLASS;
-                                n.life=0;
-                            }else if(n.type==Element::WATER || n.type==Element::SALTWATER){
-                                n.type=Element::STONE;
-                                n.life=0;
-                                if(chance(50)){
-                                    cell.type=Element::STEAM;
-                                    cell.life=20;
-                                }else{
-                                    cell.type=Element::STONE;
-                                    cell.life=0;
-                                }
-                            }else if(n.type==Element::ICE){
-                                n.type=Element::WATER;
-                                n.life=0;
-                            }
-                        }
-                    }
+            // oil/ethanol ignite
+            if constexpr(T==Element::OIL || T==Element::ETHANOL){
+                if(gType[n]==Element::FIRE || gType[n]==Element::LAVA){
+                    set_cell(cell,Element::FIRE,25);
                 }
+            }
 
-                // lava cools
-                if(t==Element::LAVA){
-                    cell.life++;
-                    if(cell.life>200){
-                        cell.type=Element::STONE;
-                        cell.life=0;
+            // acid eats stuff
+            if constexpr(T==Element::ACID){
+                if(dissolvable(gType[n])){
+                    if(chance(30)){
+                        set_cell(n,Element::TOXIC_GAS,25);
+                    }else{
+                        set_cell(n,Element::EMPTY,0);
+                    }
+                    if(chance(25)){
+                        set_cell(cell,Element::EMPTY,0);
                     }
                 }
-
-                // hydrate dirt
-                if(t==Element::WATER || t==Element::SALTWATER){
-                    for(int dy=-1;dy<=1;++dy)
-                        for(int dx=-1;dx<=1;++dx){
-                            int nx=x+dx, ny=y+dy;
-                            if(!in_bounds(nx,ny)) continue;
-                            Cell &n=grid[ny][nx];
-                            if(n.type==Element::DIRT || n.type==Element::WET_DIRT){
-                                n.type=Element::WET_DIRT;
-                                n.life=300;
-                            }
+                if(gType[n]==Element::WATER){
+                    if(chance(30)){
+                        set_cell(cell,Element::SALTWATER,0);
+                        if(chance(30)){
+                            set_cell(n,Element::STEAM,20);
                         }
+                    }else{
+                        wake(x,y);
+                    }
                 }
+            }
 
-                // electrified water pulse (yellow, harmful)
-                if((t==Element::WATER || t==Element::SALTWATER) && cell.life>0){
-                    int q = cell.life;
-                    for(int dy=-1;dy<=1;++dy){
-                        for(int dx=-1;dx<=1;++dx){
-                            if(!dx && !dy) continue;
-                            int nx=x+dx, ny=y+dy;
-                            if(!in_bounds(nx,ny)) continue;
-                            Cell &n=grid[ny][nx];
-                            if(n.type==Element::WATER || n.type==Element::SALTWATER){
-                                if(n.life < q-1) n.life = q-1;
-                            }
-                            if(n.type==Element::HUMAN || n.type==Element::ZOMBIE){
-                                n.type=Element::ASH;
-                                n.life=0;
-                            }
-                        }
+            // lava
+            if constexpr(T==Element::LAVA){
+                if(flammable(gType[n])){
+                    set_cell(n,Element::FIRE,25);
+                }else if(gType[n]==Element::SAND || gType[n]==Element::SNOW){
+                    set_cell(n,Element::GLASS,0);
+                }else if(watery(gType[n])){
+                    set_cell(n,Element::STONE,0);
+                    if(chance(50)){
+                        set_cell(cell,Element::STEAM,20);
+                    }else{
+                        set_cell(cell,Element::STONE,0);
                     }
-                    cell.life--;
-                    if(cell.life<0) cell.life=0;
+                }else if(gType[n]==Element::ICE){
+                    set_cell(n,Element::WATER,0);
                 }
-
-                continue;
             }
+        }
+    }
 
-            // --- gases ---
-            if(gas(t)){
-                bool moved=false;
+    // lava cools
+    if constexpr(T==Element::LAVA){
+        set_life(cell,gLife[cell]+1);
+        if(gLife[cell]>200){
+            set_cell(cell,Element::STONE,0);
+        }
+    }
 
-                int tries = (t==Element::HYDROGEN ? 2 : 1);
-                for(int i=0;i<tries && !moved;++i){
-                    if(in_bounds(x,y-1) && empty(grid[y-1][x])){
-                        swap_to(x,y-1);
-                        moved=true;
-                    }
+    // hydrate dirt
+    if constexpr(watery(T)){
+        for(int dy=-1;dy<=1;++dy)
+            for(int dx=-1;dx<=1;++dx){
+                int nx=x+dx, ny=y+dy;
+                if(!in_bounds(nx,ny)) continue;
+                const int n = idx(nx,ny);
+                if(gType[n]==Element::DIRT || gType[n]==Element::WET_DIRT){
+                    set_cell(n,Element::WET_DIRT,300);
                 }
+            }
+    }
 
-                if(!moved){
-                    int order[2]={-1,1};
-                    if(rint(0,1)) std::swap(order[0],order[1]);
-                    for(int i=0;i<2 && !moved;++i){
-                        int nx=x+order[i];
-                        int ny=y-(chance(50)?1:0);
-                        if(in_bounds(nx,ny) && empty(grid[ny][nx])){
-                            swap_to(nx,ny);
-                            moved=true;
-                        }
-                    }
+    // electrified water pulse (yellow, harmful)
+    if(watery(T) && gLife[cell]>0){
+        int q = gLife[cell];
+        for(int dy=-1;dy<=1;++dy){
+            for(int dx=-1;dx<=1;++dx){
+                if(!dx && !dy) continue;
+                int nx=x+dx, ny=y+dy;
+                if(!in_bounds(nx,ny)) continue;
+                const int n = idx(nx,ny);
+                if(watery(gType[n]) && !gChargeNet){
+                    if(gLife[n]<q-1) set_life(n,q-1);
+                }
+                if(gType[n]==Element::HUMAN || gType[n]==Element::ZOMBIE){
+                    set_cell(n,Element::ASH,0);
                 }
+            }
+        }
+        set_life(cell,gLife[cell]-1);
+        if(gLife[cell]<0) set_life(cell,0);
+    }
+}
 
-                if(t==Element::HYDROGEN || t==Element::GAS){
-                    for(int dy=-1;dy<=1;++dy)
-                        for(int dx=-1;dx<=1;++dx){
-                            if(!dx && !dy) continue;
-                            int nx=x+dx, ny=y+dy;
-                            if(!in_bounds(nx,ny)) continue;
-                            Element ne=grid[ny][nx].type;
-                            if(ne==Element::FIRE || ne==Element::LAVA){
-                                if(t==Element::HYDROGEN) explode(x,y,4);
-                                else { cell.type=Element::FIRE; cell.life=12; }
-                            }
-                        }
+// --- gases ---
+template<Element T>
+static void update_gas(int x,int y,int cell){
+    bool moved=false;
+
+    constexpr int tries = (T==Element::HYDROGEN ? 2 : 1);
+    for(int i=0;i<tries && !moved;++i){
+        if(in_bounds(x,y-1) && empty(gType[idx(x,y-1)])){
+            move_to(cell,x,y-1);
+            moved=true;
+        }
+    }
+
+    if(!moved){
+        int order[2]={-1,1};
+        if(rint(0,1)) std::swap(order[0],order[1]);
+        for(int i=0;i<2 && !moved;++i){
+            int nx=x+order[i];
+            int ny=y-(chance(50)?1:0);
+            if(in_bounds(nx,ny) && empty(gType[idx(nx,ny)])){
+                move_to(cell,nx,ny);
+                moved=true;
+            }
+        }
+    }
+
+    if constexpr(T==Element::HYDROGEN || T==Element::GAS){
+        for(int dy=-1;dy<=1;++dy)
+            for(int dx=-1;dx<=1;++dx){
+                if(!dx && !dy) continue;
+                int nx=x+dx, ny=y+dy;
+                if(!in_bounds(nx,ny)) continue;
+                Element ne=gType[idx(nx,ny)];
+                if(ne==Element::FIRE || ne==Element::LAVA){
+                    if constexpr(T==Element::HYDROGEN) explode(x,y,4);
+                    else { set_cell(cell,Element::FIRE,12); }
                 }
-                if(t==Element::CHLORINE){
-                    for(int dy=-1;dy<=1;++dy)
-                        for(int dx=-1;dx<=1;++dx){
-                            int nx=x+dx, ny=y+dy;
-                            if(!in_bounds(nx,ny)) continue;
-                            if(grid[ny][nx].type==Element::PLANT && chance(35)){
-                                grid[ny][nx].type=Element::TOXIC_GAS;
-                                grid[ny][nx].life=25;
-                            }
-                        }
+            }
+    }
+    if constexpr(T==Element::CHLORINE){
+        for(int dy=-1;dy<=1;++dy)
+            for(int dx=-1;dx<=1;++dx){
+                int nx=x+dx, ny=y+dy;
+                if(!in_bounds(nx,ny)) continue;
+                if(gType[idx(nx,ny)]==Element::PLANT && chance(35)){
+                    set_cell(idx(nx,ny),Element::TOXIC_GAS,25);
                 }
+            }
+    }
 
-                cell.life--;
-                if(cell.life<=0){
-                    // much less water / ash generation
-                    if(t==Element::STEAM && chance(15)){
-                        cell.type=Element::WATER;
-                        cell.life=0;
-                    }else if(t==Element::SMOKE && chance(8)){
-                        cell.type=Element::ASH;
-                        cell.life=0;
-                    }else{
-                        cell.type=Element::EMPTY;
-                        cell.life=0;
-                    }
+    age_particle(cell);
+    if(gLife[cell]<=0){
+        // much less water / ash generation
+        if(T==Element::STEAM && chance(15)){
+            set_cell(cell,Element::WATER,0);
+        }else if(T==Element::SMOKE && chance(8)){
+            set_cell(cell,Element::ASH,0);
+        }else{
+            set_cell(cell,Element::EMPTY,0);
+        }
+    }else{
+        if(!moved) gStamp[cell]=gTick;
+    }
+}
+
+// --- fire ---
+static void update_fire(int x,int y,int cell){
+    // flicker upward
+    if(in_bounds(x,y-1) && (empty(gType[idx(x,y-1)]) || gas(gType[idx(x,y-1)])) && chance(50)){
+        move_to(cell,x,y-1);
+    }
+
+    for(int dy=-1;dy<=1;++dy)
+        for(int dx=-1;dx<=1;++dx){
+            if(!dx && !dy) continue;
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            const int n = idx(nx,ny);
+
+            if(flammable(gType[n]) && chance(40)){
+                if(gType[n]==Element::GUNPOWDER) explode(nx,ny,5);
+                else { set_cell(n,Element::FIRE,15+rint(0,10)); }
+            }
+            if(watery(gType[n])){
+                set_cell(cell,Element::SMOKE,15);
+            }
+            if(gType[n]==Element::WIRE || gType[n]==Element::METAL){
+                if(chance(5)) charge(n,5);
+            }
+        }
+
+    age_particle(cell);
+    if(gLife[cell]<=0){
+        set_cell(cell,Element::SMOKE,15);
+    }
+    gStamp[cell]=gTick;
+}
+
+// --- lightning: charge & ignite, then vanish (no ash) ---
+static void update_lightning(int x,int y,int cell){
+    for(int dy=-2;dy<=2;++dy)
+        for(int dx=-2;dx<=2;++dx){
+            if(!dx && !dy) continue;
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            const int n = idx(nx,ny);
+            Element ne=gType[n];
+            if(ne==Element::WIRE || ne==Element::METAL){
+                charge(n,12);
+            }
+            if(watery(ne)){
+                charge(n,8);
+            }
+            if(flammable(ne)){
+                if(ne==Element::GUNPOWDER) explode(nx,ny,6);
+                else { set_cell(n,Element::FIRE,20+rint(0,10)); }
+            }
+            if(ne==Element::HYDROGEN || ne==Element::GAS){
+                explode(nx,ny,4);
+            }
+        }
+    age_particle(cell);
+    if(gLife[cell]<=0){
+        set_cell(cell,Element::EMPTY,0);
+    }
+    gStamp[cell]=gTick;
+}
+
+// --- HUMAN ---
+static void update_human(int x,int y,int cell){
+    // environmental hazards kill humans (including electrified water)
+    bool killed=false;
+    for(int dy=-1;dy<=1 && !killed;++dy){
+        for(int dx=-1;dx<=1 && !killed;++dx){
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            if(harms_actors(idx(nx,ny))){
+                set_cell(cell,Element::ASH,0);
+                killed=true;
+            }
+        }
+    }
+    if(killed){
+        gStamp[cell]=gTick;
+        return;
+    }
+
+    set_life(cell,gLife[cell]+1); // anim tick
+
+    // gravity: only fall through air/gas (not liquids)
+    if(in_bounds(x,y+1)){
+        Element b=gType[idx(x,y+1)];
+        if(empty(gType[idx(x,y+1)]) || gas(b)){
+            move_to(cell,x,y+1);
+            return;
+        }
+    }
+
+    // look for nearest zombie
+    int zx = 0, zy = 0;
+    bool seen=find_actor(x,y,Element::ZOMBIE,zx,zy);
+
+    // attack adjacent zombies
+    for(int dy=-1;dy<=1;++dy)
+        for(int dx=-1;dx<=1;++dx){
+            if(!dx && !dy) continue;
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            if(gType[idx(nx,ny)]==Element::ZOMBIE && chance(35)){
+                if(chance(60)){
+                    set_cell(idx(nx,ny),Element::FIRE,10+rint(0,10));
                 }else{
-                    if(!moved) updated[y][x]=true;
+                    set_cell(idx(nx,ny),Element::ASH,0);
                 }
-                continue;
             }
+        }
 
-            // --- fire ---
-            if(t==Element::FIRE){
-                // flicker upward
-                if(in_bounds(x,y-1) && (empty(grid[y-1][x]) || gas(grid[y-1][x].type)) && chance(50)){
-                    swap_to(x,y-1);
-                }
+    int dir = rint(0,1)?1:-1;
+    if(seen){
+        // run away
+        dir = (zx<x)?1:-1;
+    }
+
+    if(!walk_try(cell,x+dir,y)){
+        // small jump over 1-tile obstacles
+        if(in_bounds(x+dir,y-1) && empty(gType[idx(x+dir,y-1)]) && empty(gType[idx(x,y-1)]) && chance(70)){
+            swap_cells(idx(x,y-1), cell);
+        }else{
+            walk_try(cell,x+(rint(0,1)?1:-1), y);
+        }
+    }
 
-                for(int dy=-1;dy<=1;++dy)
-                    for(int dx=-1;dx<=1;++dx){
-                        if(!dx && !dy) continue;
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        Cell &n=grid[ny][nx];
+    gStamp[cell]=gTick;
+}
 
-                        if(flammable(n.type) && chance(40)){
-                            if(n.type==Element::GUNPOWDER) explode(nx,ny,5);
-                            else { n.type=Element::FIRE; n.life=15+rint(0,10); }
-                        }
-                        if(n.type==Element::WATER || n.type==Element::SALTWATER){
-                            cell.type=Element::SMOKE;
-                            cell.life=15;
-                        }
-                        if(n.type==Element::WIRE || n.type==Element::METAL){
-                            if(chance(5)) n.life=std::max(n.life,5);
-                        }
-                    }
+// --- ZOMBIE ---
+static void update_zombie(int x,int y,int cell){
+    // hazards kill/burn zombies too (including electrified water)
+    for(int dy=-1;dy<=1;++dy){
+        for(int dx=-1;dx<=1;++dx){
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            if(harms_actors(idx(nx,ny))){
+                set_cell(cell,Element::FIRE,15);
+            }
+        }
+    }
+    if(gType[cell]!=Element::ZOMBIE){
+        gStamp[cell]=gTick;
+        return;
+    }
+
+    set_life(cell,gLife[cell]+1);
 
-                cell.life--;
-                if(cell.life<=0){
-                    cell.type=Element::SMOKE;
-                    cell.life=15;
+    // gravity: only air/gas
+    if(in_bounds(x,y+1)){
+        Element b=gType[idx(x,y+1)];
+        if(empty(gType[idx(x,y+1)]) || gas(b)){
+            move_to(cell,x,y+1);
+            return;
+        }
+    }
+
+    // look for human
+    int hx=0, hy=0;
+    bool seen=find_actor(x,y,Element::HUMAN,hx,hy);
+
+    // infect/attack adjacent humans
+    for(int dy=-1;dy<=1;++dy)
+        for(int dx=-1;dx<=1;++dx){
+            if(!dx && !dy) continue;
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            if(gType[idx(nx,ny)]==Element::HUMAN){
+                if(chance(70)){
+                    set_cell(idx(nx,ny),Element::ZOMBIE,0);
+                }else{
+                    set_cell(idx(nx,ny),Element::FIRE,10);
                 }
-                updated[y][x]=true;
-                continue;
             }
+        }
 
-            // --- lightning: charge & ignite, then vanish (no ash) ---
-            if(t==Element::LIGHTNING){
-                for(int dy=-2;dy<=2;++dy)
-                    for(int dx=-2;dx<=2;++dx){
-                        if(!dx && !dy) continue;
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        Cell &n=grid[ny][nx];
-                        Element ne=n.type;
-                        if(ne==Element::WIRE || ne==Element::METAL){
-                            n.life=std::max(n.life,12);
-                        }
-                        if(ne==Element::WATER || ne==Element::SALTWATER){
-                            n.life=std::max(n.life,8);
-                        }
-                        if(flammable(ne)){
-                            if(ne==Element::GUNPOWDER) explode(nx,ny,6);
-                            else { n.type=Element::FIRE; n.life=20+rint(0,10); }
-                        }
-                        if(ne==Element::HYDROGEN || ne==Element::GAS){
-                            explode(nx,ny,4);
-                        }
-                    }
-                cell.life--;
-                if(cell.life<=0){
-                    cell.type=Element::EMPTY;
-                    cell.life=0;
-                }
-                updated[y][x]=true;
-                continue;
+    int dir = seen ? ((hx>x)?1:-1) : (rint(0,1)?1:-1);
+    if(!walk_try(cell,x+dir,y)){
+        if(in_bounds(x+dir,y-1) && empty(gType[idx(x+dir,y-1)]) && empty(gType[idx(x,y-1)]) && chance(70)){
+            swap_cells(idx(x,y-1), cell);
+        }else{
+            walk_try(cell,x+(rint(0,1)?1:-1), y);
+        }
+    }
+
+    gStamp[cell]=gTick;
+}
+
+// --- wet dirt drying ---
+static void update_wet_dirt(int x,int y,int cell){
+    bool nearWater=false;
+    for(int dy=-1;dy<=1 && !nearWater;++dy)
+        for(int dx=-1;dx<=1;++dx){
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            Element ne=gType[idx(nx,ny)];
+            if(watery(ne)){
+                nearWater=true; break;
             }
+        }
+    if(!nearWater){
+        set_life(cell,gLife[cell]-1);
+        if(gLife[cell]<=0){
+            set_cell(cell,Element::DIRT,0);
+        }
+    }
+    gStamp[cell]=gTick;
+}
 
-            // small helpers for creatures
-            auto walk_try = [&](int tx,int ty)->bool{
-                if(!in_bounds(tx,ty)) return false;
-                Cell &d=grid[ty][tx];
-                if(empty(d) || gas(d.type)){
-                    std::swap(d,cell);
-                    return true;
-                }
-                return false;
-            };
-
-            // --- HUMAN ---
-            if(t==Element::HUMAN){
-                // environmental hazards kill humans (including electrified water)
-                bool killed=false;
-                for(int dy=-1;dy<=1 && !killed;++dy){
-                    for(int dx=-1;dx<=1 && !killed;++dx){
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        Element ne=grid[ny][nx].type;
-                        if(is_hazard(ne) ||
-                           ((ne==Element::WATER || ne==Element::SALTWATER) && grid[ny][nx].life>0)){
-                            cell.type=Element::ASH;
-                            cell.life=0;
-                            killed=true;
-                        }
+// --- plants & seaweed ---
+template<Element T>
+static void update_growth(int x,int y,int cell){
+    // burning
+    for(int dy=-1;dy<=1;++dy)
+        for(int dx=-1;dx<=1;++dx){
+            if(!dx && !dy) continue;
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            if(gType[idx(nx,ny)]==Element::FIRE || gType[idx(nx,ny)]==Element::LAVA){
+                set_cell(cell,Element::FIRE,20);
+            }
+        }
+
+    if(gType[cell]==Element::FIRE){
+        gStamp[cell]=gTick;
+        return;
+    }
+
+    if constexpr(T==Element::PLANT){
+        bool goodSoil = (in_bounds(x,y+1) && gType[idx(x,y+1)]==Element::WET_DIRT);
+        // more controlled, mainly vertical growth
+        if(goodSoil && chance(2)){
+            int gx=x, gy=y-1;
+            if(in_bounds(gx,gy) && empty(gType[idx(gx,gy)])){
+                set_cell(idx(gx,gy),Element::PLANT,0);
+            }
+        }else if(goodSoil && in_bounds(x,y-1) && empty(gType[idx(x,y-1)])){
+            wake(x,y); // may still grow; don't let the chunk sleep
+        }
+    }else{ // SEAWEED
+        bool underwater = in_bounds(x,y-1) && watery(gType[idx(x,y-1)]);
+        bool isTop = !in_bounds(x,y-1) || gType[idx(x,y-1)]!=Element::SEAWEED;
+        if(underwater && isTop && chance(2)){
+            int gy=y-1;
+            if(in_bounds(x,gy) &&
+               watery(gType[idx(x,gy)])){
+                set_cell(idx(x,gy),Element::SEAWEED,0);
+            }
+        }else if(underwater && isTop){
+            wake(x,y);
+        }
+    }
+    gStamp[cell]=gTick;
+}
+
+// --- wood/coal burn ---
+template<Element T>
+static void update_burnable(int x,int y,int cell){
+    for(int dy=-1;dy<=1;++dy)
+        for(int dx=-1;dx<=1;++dx){
+            if(!dx && !dy) continue;
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            if(gType[idx(nx,ny)]==Element::FIRE || gType[idx(nx,ny)]==Element::LAVA){
+                set_cell(cell,Element::FIRE,(T==Element::COAL ? 35 : 25));
+            }
+        }
+    gStamp[cell]=gTick;
+}
+
+// --- wire / metal conduction ---
+static void update_conductor(int x,int y,int cell){
+    if(gLife[cell]>0){
+        int q=gLife[cell];
+        for(int dy=-1;dy<=1;++dy)
+            for(int dx=-1;dx<=1;++dx){
+                if(!dx && !dy) continue;
+                int nx=x+dx, ny=y+dy;
+                if(!in_bounds(nx,ny)) continue;
+                const int n = idx(nx,ny);
+                if(!gChargeNet){   // otherwise flush_charges() spread it already
+                    if(wired(gType[n])){
+                        if(gLife[n]<q-1) set_life(n,q-1);
+                    }
+                    // wire can shock water too
+                    if(watery(gType[n])){
+                        if(gLife[n]<q-1) set_life(n,q-1);
                     }
                 }
-                if(killed){
-                    updated[y][x]=true;
-                    continue;
+                if(flammable(gType[n]) && chance(15)){
+                    if(gType[n]==Element::GUNPOWDER) explode(nx,ny,5);
+                    else { set_cell(n,Element::FIRE,15+rint(0,10)); }
                 }
+                if(gType[n]==Element::HYDROGEN || gType[n]==Element::GAS){
+                    if(chance(35)) explode(nx,ny,4);
+                }
+            }
+        set_life(cell,gLife[cell]-1);
+        if(gLife[cell]<0) set_life(cell,0);
+    }
+    gStamp[cell]=gTick;
+}
+
+// --- ice ---
+static void update_ice(int x,int y,int cell){
+    for(int dy=-1;dy<=1;++dy)
+        for(int dx=-1;dx<=1;++dx){
+            int nx=x+dx, ny=y+dy;
+            if(!in_bounds(nx,ny)) continue;
+            Element ne=gType[idx(nx,ny)];
+            if(ne==Element::FIRE || ne==Element::LAVA || ne==Element::STEAM){
+                if(chance(25)){
+                    set_cell(cell,Element::WATER,0);
+                }else{
+                    wake(x,y); // keep rolling while the heat stays
+                }
+            }
+        }
+    gStamp[cell]=gTick;
+}
+
+// The kernel for element T, by the same tests in the same order as the old
+// if-chain (so gunpowder, a powder, takes the powder kernel).
+template<Element T>
+static constexpr Kernel kernel_for(){
+    if constexpr(sandlike(T))                           return update_powder<T>;
+    else if constexpr(liquid(T))                        return update_liquid<T>;
+    else if constexpr(gas(T))                           return update_gas<T>;
+    else if constexpr(T==Element::FIRE)                 return update_fire;
+    else if constexpr(T==Element::LIGHTNING)            return update_lightning;
+    else if constexpr(T==Element::HUMAN)                return update_human;
+    else if constexpr(T==Element::ZOMBIE)               return update_zombie;
+    else if constexpr(T==Element::WET_DIRT)             return update_wet_dirt;
+    else if constexpr(T==Element::PLANT || T==Element::SEAWEED) return update_growth<T>;
+    else if constexpr(T==Element::WOOD || T==Element::COAL)     return update_burnable<T>;
+    else if constexpr(wired(T))                         return update_conductor;
+    else if constexpr(T==Element::ICE)                  return update_ice;
+    else                                                return update_inert;
+}
+template<size_t... I>
+static constexpr std::array<Kernel,ELEMENT_COUNT> make_kernels(std::index_sequence<I...>){
+    return {kernel_for<(Element)I>()...};
+}
+static constexpr std::array<Kernel,ELEMENT_COUNT> KERNELS = make_kernels(std::make_index_sequence<ELEMENT_COUNT>{});
+
+static void update_cell(int x,int y){
+    const int cell = idx(x,y);
+    if(gStamp[cell]==gTick) return;
+    Element t = gType[cell];
+    if(t==Element::EMPTY || t==Element::WALL){
+        gStamp[cell]=gTick;
+        return;
+    }
+    ++tCellTally[STAT_CAT.cat[(int)t]];
+    TRACE_CELL(name_of(t));
+    KERNELS[(int)t](x,y,cell);
+}
+
+// update_cell only stamps EMPTY, WALL and the inert solids (stone, glass,
+// dry dirt), and those make up most of a typical sweep. sweep_row builds a
+// bitmask of the cells that need work, up to a chunk row (32 cells) at a
+// time, with vector compares and only calls update_cell for set bits;
+// particles are masked out too, since update_particles visits those. An
+// update can put something into a cell further along the row that the mask
+// saw as idle, so after each one the next SIM_REACH cells are rechecked.
+// IDLE must be exactly the elements whose kernel is update_inert, which the
+// static_assert checks.
+static constexpr Element IDLE[] = {
+    Element::EMPTY, Element::WALL, Element::STONE, Element::GLASS, Element::DIRT
+};
+static constexpr int IDLE_COUNT = (int)(sizeof(IDLE)/sizeof(IDLE[0]));
+
+static constexpr bool needs_work(Element e){
+    for(Element i : IDLE) if(e==i) return false;
+    return true;
+}
+static constexpr bool idle_matches_kernels(){
+    for(int i=0;i<ELEMENT_COUNT;++i)
+        if(needs_work((Element)i)==(KERNELS[i]==update_inert)) return false;
+    return true;
+}
+static_assert(idle_matches_kernels(), "IDLE and the update_inert kernels disagree");
+
+// bit i set when p[i] needs work, for n<=CHUNK cells
+static inline uint32_t work_mask(const Element* p, int n){
+    const uint8_t* b=reinterpret_cast<const uint8_t*>(p);
+    uint32_t m=0;
+    int i=0;
+#if defined(__AVX2__)
+    for(; i+32<=n; i+=32){
+        __m256i v=_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+i));
+        __m256i idle=_mm256_setzero_si256();
+        for(int k=0;k<IDLE_COUNT;++k)
+            idle=_mm256_or_si256(idle,_mm256_cmpeq_epi8(v,_mm256_set1_epi8((char)IDLE[k])));
+        m |= (uint32_t)~_mm256_movemask_epi8(idle) << i;
+    }
+#endif
+#if defined(__SSE2__)
+    for(; i+16<=n; i+=16){
+        __m128i v=_mm_loadu_si128(reinterpret_cast<const __m128i*>(b+i));
+        __m128i idle=_mm_setzero_si128();
+        for(int k=0;k<IDLE_COUNT;++k)
+            idle=_mm_or_si128(idle,_mm_cmpeq_epi8(v,_mm_set1_epi8((char)IDLE[k])));
+        m |= (uint32_t)(~_mm_movemask_epi8(idle) & 0xFFFF) << i;
+    }
+#endif
+    for(; i<n; ++i)
+        if(needs_work((Element)b[i])) m |= 1u<<i;
+    return m;
+}
+
+// Visit row y from x0 to the rect's right edge, which may grow meanwhile.
+// A rect never leaves its chunk, so each pass covers at most CHUNK cells and
+// its mask lines up with the chunk's 32-bit particle rows.
+static inline void sweep_row(int y, int x0, const DirtyRect& r){
+    const Element* row=&gType[(size_t)y*gWidth];
+    for(int x=x0; x<=r.x1; ){
+        const int n=std::min(CHUNK, r.x1-x+1);
+        uint32_t m=work_mask(row+x,n) & ~particles_from(x,y);
+        while(m){
+            const int b=__builtin_ctz(m);
+            update_cell(x+b,y);
+            m &= ~(1u<<b);
+            const int k=std::min(SIM_REACH, n-b-1);
+            if(k>0){
+                const uint32_t ahead=((1u<<k)-1) << (b+1);
+                if((m&ahead)!=ahead)
+                    m |= (work_mask(row+x+b+1,k) & ~particles_from(x+b+1,y)) << (b+1);
+            }
+        }
+        x+=n;
+    }
+}
+
+// Visit the particles in row y of chunk (cx, y/CHUNK) left to right,
+// including any that move or spawn further along the row meanwhile.
+static inline void update_particles(int y, int cx, int k){
+    const std::atomic<uint32_t>& bits=gParticleRows[(size_t)k*CHUNK + y%CHUNK];
+    uint32_t done=0;
+    for(uint32_t m; (m=bits.load(std::memory_order_relaxed) & ~done)!=0; ){
+        const int b=__builtin_ctz(m);
+        done |= (2u<<b)-1;
+        update_cell(cx*CHUNK+b,y);
+    }
+}
+
+static inline void bump_tick(){
+    if(++gTick==0){
+        gStamp.zero();
+        gTick=1;
+    }
+    ++gFrame;
+}
+
+static void step_sim_serial(){
+    TRACE_SCOPE("sweep");
+    for(int y=gHeight-1; y>=0; --y){
+        const int k0=(y/CHUNK)*gChunksW;
+        for(int ci=0; ci<gChunksW; ++ci){
+            const DirtyRect& r=gDirtyCur[k0+ci];   // may grow while we sweep
+            if(y>=r.y0 && y<=r.y1) sweep_row(y,r.x0,r);
+            if(gParticleCount[k0+ci].load(std::memory_order_relaxed)) update_particles(y,ci,k0+ci);
+        }
+    }
+    flush_cell_tally();
+}
+
+// Checkerboard schedule: chunks are split into four phases by (cx&1, cy&1).
+// Chunks in one phase are a full chunk apart, and since 2*SIM_REACH < CHUNK
+// no two of them can touch the same cell, so each phase runs on the pool
+// with no locking; the only shared writes are the neighbours' dirty rects,
+// which grow atomically, and the explosion/charge queues, which are locked.
+// Every chunk draws from its own RNG stream keyed by (seed, frame, chunk),
+// so results do not depend on the thread count.
+static_assert(2*SIM_REACH < CHUNK, "chunks too small for the parallel schedule");
+static_assert(MAX_FLOW < SIM_REACH, "liquid flow scans beyond SIM_REACH");
+
+static void sweep_chunk(int k){
+    TRACE_SCOPE("sweep_chunk");
+    rng.reseed(gSeed ^ (gFrame*0x9E3779B97F4A7C15ULL), (uint64_t)k+1);
+    const DirtyRect& r=gDirtyCur[k];
+    const int cx=k%gChunksW, y0=(k/gChunksW)*CHUNK, y1=std::min(gHeight,y0+CHUNK)-1;
+    for(int y=y1; y>=y0; --y){
+        if(y>=r.y0 && y<=r.y1) sweep_row(y,r.x0,r);
+        update_particles(y,cx,k);
+    }
+    flush_cell_tally();
+}
+
+static void step_sim_parallel(){
+    Rng saved=rng;
+    std::vector<int> work;
+    work.reserve(gDirtyCur.size()/4+1);
+    for(int phase=0; phase<4; ++phase){
+        work.clear();
+        for(int cy=phase>>1; cy<gChunksH; cy+=2)
+            for(int cx=phase&1; cx<gChunksW; cx+=2){
+                int k=cy*gChunksW+cx;
+                if(!gDirtyCur[k].empty() || gParticleCount[k].load(std::memory_order_relaxed))
+                    work.push_back(k);
+            }
+        gPool->run((int)work.size(), [&](int i){ sweep_chunk(work[i]); });
+    }
+    rng=saved;
+}
 
-                cell.life++; // anim tick
+static void step_sim(){
+    if(gWidth<=0||gHeight<=0) return;
+    using Clock = std::chrono::steady_clock;
+    auto ms = [](Clock::time_point a, Clock::time_point b){
+        return std::chrono::duration<double,std::milli>(b-a).count();
+    };
+    TRACE_SCOPE("step_sim");
+    auto t0=Clock::now();
+    bump_tick();
+    begin_chunk_tick();
+    if(gPool && gPool->size()>1) step_sim_parallel();
+    else step_sim_serial();
+    auto t1=Clock::now();
+    apply_explosions();
+    auto t2=Clock::now();
+    flush_charges();
+    auto t3=Clock::now();
+
+    gLastTick.sweepMs=ms(t0,t1);
+    gLastTick.blastMs=ms(t1,t2);
+    gLastTick.chargeMs=ms(t2,t3);
+    for(int k=0;k<STAT_CATS;++k){
+        gLastTick.cells[k]=gCellTally[k].exchange(0,std::memory_order_relaxed);
+        TRACE_COUNTER(STAT_NAMES[k],gLastTick.cells[k]);
+    }
+}
 
-                // gravity: only fall through air/gas (not liquids)
-                if(in_bounds(x,y+1)){
-                    Element b=grid[y+1][x].type;
-                    if(empty(grid[y+1][x]) || gas(b)){
-                        swap_to(x,y+1);
-                        continue;
-                    }
-                }
+// ===== Save / load =====
+// World snapshot, host byte order:
+//   "PWDR", u32 version, i32 width, i32 height, u64 seed, u64 frame
+//   u32 runs, then runs x { u32 count, u8  type }    (type plane, RLE)
+//   u32 runs, then runs x { u32 count, i32 life }    (life plane, RLE)
+// Loading reads the whole file in one go and expands each run into the
+// freshly zeroed planes, skipping runs of zero so sky stays unbacked.
+static constexpr char     SAVE_MAGIC[4] = {'P','W','D','R'};
+static constexpr uint32_t SAVE_VERSION  = 1;
+
+template<class T>
+static void put(std::string& out, const T& v){ out.append((const char*)&v, sizeof v); }
+
+template<class T>
+static bool get(const char*& p, const char* end, T& v){
+    if(end-p<(std::ptrdiff_t)sizeof v) return false;
+    std::memcpy(&v,p,sizeof v);
+    p+=sizeof v;
+    return true;
+}
 
-                // look for nearest zombie
-                int zx = 0, zy = 0;
-                bool seen=false;
-                for(int ry=-6; ry<=6 && !seen; ++ry){
-                    for(int rx=-6; rx<=6; ++rx){
-                        int nx=x+rx, ny=y+ry;
-                        if(!in_bounds(nx,ny)) continue;
-                        if(grid[ny][nx].type==Element::ZOMBIE){
-                            zx=nx; zy=ny; seen=true; break;
-                        }
-                    }
-                }
+template<class T>
+static void put_runs(std::string& out, const Plane<T>& plane){
+    const size_t at=out.size();
+    uint32_t runs=0;
+    put(out,runs);
+    for(size_t i=0;i<plane.size();){
+        size_t j=i+1;
+        while(j<plane.size() && plane[j]==plane[i] && j-i<UINT32_MAX) ++j;
+        put(out,(uint32_t)(j-i));
+        put(out,plane[i]);
+        ++runs;
+        i=j;
+    }
+    std::memcpy(&out[at],&runs,sizeof runs);
+}
 
-                // attack adjacent zombies
-                for(int dy=-1;dy<=1;++dy)
-                    for(int dx=-1;dx<=1;++dx){
-                        if(!dx && !dy) continue;
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        if(grid[ny][nx].type==Element::ZOMBIE && chance(35)){
-                            if(chance(60)){
-                                grid[ny][nx].type=Element::FIRE;
-                                grid[ny][nx].life=10+rint(0,10);
-                            }else{
-                                grid[ny][nx].type=Element::ASH;
-                                grid[ny][nx].life=0;
-                            }
-                        }
-                    }
+template<class T, class Valid>
+static bool get_runs(const char*& p, const char* end, Plane<T>& plane, Valid valid){
+    uint32_t runs;
+    if(!get(p,end,runs)) return false;
+    size_t at=0;
+    for(uint32_t r=0;r<runs;++r){
+        uint32_t n; T v;
+        if(!get(p,end,n) || !get(p,end,v)) return false;
+        if(n>plane.size()-at || !valid(v)) return false;
+        if(!(v==T{})) std::fill_n(plane.begin()+at,n,v);
+        at+=n;
+    }
+    return at==plane.size();
+}
 
-                int dir = rint(0,1)?1:-1;
-                if(seen){
-                    // run away
-                    dir = (zx<x)?1:-1;
-                }
+static void encode_world(std::string& out){
+    out.append(SAVE_MAGIC,4);
+    put(out,SAVE_VERSION);
+    put(out,(int32_t)gWidth);
+    put(out,(int32_t)gHeight);
+    put(out,(uint64_t)gSeed);
+    put(out,(uint64_t)gFrame);
+    put_runs(out,gType);
+    put_runs(out,gLife);
+}
 
-                if(!walk_try(x+dir,y)){
-                    // small jump over 1-tile obstacles
-                    if(in_bounds(x+dir,y-1) && empty(grid[y-1][x+dir]) && empty(grid[y-1][x]) && chance(70)){
-                        std::swap(grid[y-1][x], cell);
-                    }else{
-                        walk_try(x+(rint(0,1)?1:-1), y);
-                    }
-                }
+static bool decode_world(const char*& p, const char* end, std::string& err){
+    char magic[4]; uint32_t version; int32_t w,h; uint64_t seed,frame;
+    if(!get(p,end,magic) || std::memcmp(magic,SAVE_MAGIC,4)!=0){ err="not a world file"; return false; }
+    if(!get(p,end,version) || version!=SAVE_VERSION){ err="unsupported version"; return false; }
+    if(!get(p,end,w) || !get(p,end,h) || !get(p,end,seed) || !get(p,end,frame) || w<=0 || h<=0){
+        err="bad header"; return false;
+    }
 
-                updated[y][x]=true;
-                continue;
-            }
+    if(!world_fits(w,h)){ err="world too large"; return false; }
 
-            // --- ZOMBIE ---
-            if(t==Element::ZOMBIE){
-                // hazards kill/burn zombies too (including electrified water)
-                for(int dy=-1;dy<=1;++dy){
-                    for(int dx=-1;dx<=1;++dx){
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        Element ne=grid[ny][nx].type;
-                        if(is_hazard(ne) ||
-                           ((ne==Element::WATER || ne==Element::SALTWATER) && grid[ny][nx].life>0)){
-                            cell.type=Element::FIRE;
-                            cell.life=15;
-                        }
-                    }
-                }
-                if(cell.type!=Element::ZOMBIE){
-                    updated[y][x]=true;
-                    continue;
-                }
+    // decode into scratch planes so a bad file leaves the live world alone
+    Plane<Element> type;
+    Plane<int> life;
+    try{
+        type.reset((size_t)w*h);
+        life.reset((size_t)w*h);
+    }catch(const std::bad_alloc&){
+        err="world too large"; return false;
+    }
+    bool ok = get_runs(p,end,type,[](Element e){ return (int)e<ELEMENT_COUNT; }) &&
+              get_runs(p,end,life,[](int){ return true; });
+    if(!ok){ err="truncated or corrupt"; return false; }
+
+    init_grid(w,h);
+    gType.swap(type);
+    gLife.swap(life);
+    gSeed=seed;
+    rng.reseed(gSeed,0);
+    gFrame=frame;
+    recount_chunks();
+    wake_all();
+    rebuild_particles();
+    rebuild_actor_buckets();
+    return true;
+}
 
-                cell.life++;
+static bool write_file(const std::string& path, const std::string& data, std::string& err){
+    FILE* f=std::fopen(path.c_str(),"wb");
+    if(!f){ err="cannot write "+path; return false; }
+    bool ok = std::fwrite(data.data(),1,data.size(),f)==data.size();
+    ok = (std::fclose(f)==0) && ok;
+    if(!ok) err="short write to "+path;
+    return ok;
+}
 
-                // gravity: only air/gas
-                if(in_bounds(x,y+1)){
-                    Element b=grid[y+1][x].type;
-                    if(empty(grid[y+1][x]) || gas(b)){
-                        swap_to(x,y+1);
-                        continue;
-                    }
-                }
+static bool read_file(const std::string& path, std::string& buf, std::string& err){
+    FILE* f=std::fopen(path.c_str(),"rb");
+    if(!f){ err="cannot open "+path; return false; }
+    std::fseek(f,0,SEEK_END);
+    long size=std::ftell(f);
+    std::fseek(f,0,SEEK_SET);
+    buf.clear();
+    if(size>0){
+        buf.resize((size_t)size);
+        buf.resize(std::fread(&buf[0],1,buf.size(),f));
+    }
+    std::fclose(f);
+    return true;
+}
 
-                // look for human
-                int hx=0, hy=0;
-                bool seen=false;
-                for(int ry=-6; ry<=6 && !seen; ++ry){
-                    for(int rx=-6; rx<=6; ++rx){
-                        int nx=x+rx, ny=y+ry;
-                        if(!in_bounds(nx,ny)) continue;
-                        if(grid[ny][nx].type==Element::HUMAN){
-                            hx=nx; hy=ny; seen=true; break;
-                        }
-                    }
-                }
+static bool save_world(const std::string& path, std::string& err){
+    std::string out;
+    encode_world(out);
+    return write_file(path,out,err);
+}
 
-                // infect/attack adjacent humans
-                for(int dy=-1;dy<=1;++dy)
-                    for(int dx=-1;dx<=1;++dx){
-                        if(!dx && !dy) continue;
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        if(grid[ny][nx].type==Element::HUMAN){
-                            if(chance(70)){
-                                grid[ny][nx].type=Element::ZOMBIE;
-                                grid[ny][nx].life=0;
-                            }else{
-                                grid[ny][nx].type=Element::FIRE;
-                                grid[ny][nx].life=10;
-                            }
-                        }
-                    }
+static bool load_world(const std::string& path, std::string& err){
+    std::string buf;
+    if(!read_file(path,buf,err)) return false;
+    const char* p=buf.data();
+    if(!decode_world(p,p+buf.size(),err)){
+        err=path+": "+err;
+        return false;
+    }
+    return true;
+}
 
-                int dir = seen ? ((hx>x)?1:-1) : (rint(0,1)?1:-1);
-                if(!walk_try(x+dir,y)){
-                    if(in_bounds(x+dir,y-1) && empty(grid[y-1][x+dir]) && empty(grid[y-1][x]) && chance(70)){
-                        std::swap(grid[y-1][x], cell);
-                    }else{
-                        walk_try(x+(rint(0,1)?1:-1), y);
-                    }
-                }
+// ===== Drawing =====
+// What is on screen right now: one glyph|colour<<8 word per screen cell of
+// the world view plus the two status lines. draw_grid only emits ncurses
+// calls for cells whose visible state differs; invalidate_screen() forces a
+// full repaint after anything else has drawn over stdscr (menus, resizes).
+// The world may be larger than the terminal; the view is the window at
+// (gCamX,gCamY), which pans to keep the cursor in sight.
+//
+// Drawing works from a View, a copy of the window's cells plus what the
+// status lines show, so it never reads the world: capture_view takes one
+// on whichever thread steps the sim, draw_grid puts one on the terminal.
+static std::vector<uint16_t> gDrawn;
+static int gDrawnW = 0;          // view width gDrawn was laid out for
+static int gCamX = 0, gCamY = 0;
+static std::string gDrawnStatus, gDrawnInfo;
+static std::atomic<bool> gRedrawAll{true};
+static std::string gMessage;   // last save/load result, shown on the info line
+
+struct View {
+    int camX=0, camY=0, w=0, h=0;   // the world window shown
+    int worldW=0, worldH=0;
+    std::vector<uint16_t> cells;    // visual_of, row-major w x h
+    int cx=0, cy=0, brush=1;        // cursor
+    Element current=Element::SAND;
+    bool paused=false, pen=false;
+    std::string message;
+};
 
-                updated[y][x]=true;
-                continue;
-            }
+static void invalidate_screen(){ gRedrawAll=true; }
 
-            // --- wet dirt drying ---
-            if(t==Element::WET_DIRT){
-                bool nearWater=false;
-                for(int dy=-1;dy<=1 && !nearWater;++dy)
-                    for(int dx=-1;dx<=1;++dx){
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        Element ne=grid[ny][nx].type;
-                        if(ne==Element::WATER || ne==Element::SALTWATER){
-                            nearWater=true; break;
-                        }
-                    }
-                if(!nearWater){
-                    cell.life--;
-                    if(cell.life<=0){
-                        cell.type=Element::DIRT;
-                        cell.life=0;
-                    }
-                }
-                updated[y][x]=true;
-                continue;
-            }
+// colour pair cell c is drawn in
+static inline short color_at(int c){
+    Element e=gType[c];
+    // electrified water pulse = yellow
+    if(watery(e) && gLife[c]>0) return 9;
+    return color_of(e);
+}
 
-            // --- plants & seaweed ---
-            if(t==Element::PLANT || t==Element::SEAWEED){
-                // burning
-                for(int dy=-1;dy<=1;++dy)
-                    for(int dx=-1;dx<=1;++dx){
-                        if(!dx && !dy) continue;
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        if(grid[ny][nx].type==Element::FIRE || grid[ny][nx].type==Element::LAVA){
-                            cell.type=Element::FIRE;
-                            cell.life=20;
-                        }
-                    }
+static inline uint16_t visual_of(int c){
+    Element e=gType[c];
+    char ch = glyph_of(e);
 
-                if(cell.type==Element::FIRE){
-                    updated[y][x]=true;
-                    continue;
-                }
+    // little "animations" / stick vibes
+    if(e==Element::HUMAN)  ch = (gLife[c]/6)%2 ? 'y' : 'Y';
+    if(e==Element::ZOMBIE) ch = (gLife[c]/6)%2 ? 't' : 'T';
+    if(e==Element::LIGHTNING) ch='|'; // straight yellow bolt
 
-                if(t==Element::PLANT){
-                    bool goodSoil = (in_bounds(x,y+1) && grid[y+1][x].type==Element::WET_DIRT);
-                    // more controlled, mainly vertical growth
-                    if(goodSoil && chance(2)){
-                        int gx=x, gy=y-1;
-                        if(in_bounds(gx,gy) && empty(grid[gy][gx])){
-                            grid[gy][gx].type=Element::PLANT;
-                            grid[gy][gx].life=0;
-                        }
-                    }
-                }else{ // SEAWEED
-                    bool underwater = in_bounds(x,y-1) &&
-                        (grid[y-1][x].type==Element::WATER || grid[y-1][x].type==Element::SALTWATER);
-                    bool isTop = !in_bounds(x,y-1) || grid[y-1][x].type!=Element::SEAWEED;
-                    if(underwater && isTop && chance(2)){
-                        int gy=y-1;
-                        if(in_bounds(x,gy) &&
-                           (grid[gy][x].type==Element::WATER || grid[gy][x].type==Element::SALTWATER)){
-                            grid[gy][x].type=Element::SEAWEED;
-                            grid[gy][x].life=0;
-                        }
-                    }
-                }
-                updated[y][x]=true;
-                continue;
-            }
+    return (uint16_t)((unsigned char)ch | (color_at(c)<<8));
+}
 
-            // --- wood/coal burn ---
-            if(t==Element::WOOD || t==Element::COAL){
-                for(int dy=-1;dy<=1;++dy)
-                    for(int dx=-1;dx<=1;++dx){
-                        if(!dx && !dy) continue;
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        if(grid[ny][nx].type==Element::FIRE || grid[ny][nx].type==Element::LAVA){
-                            cell.type=Element::FIRE;
-                            cell.life = (t==Element::COAL ? 35 : 25);
-                        }
-                    }
-                updated[y][x]=true;
-                continue;
-            }
+// redraw one status line only if its text changed
+static void draw_status_line(int y, std::string text, std::string& drawn, int maxx){
+    if((int)text.size()>maxx) text.resize(maxx);
+    if(text==drawn) return;
+    mvaddnstr(y,0,text.c_str(),maxx);
+    clrtoeol();
+    drawn=text;
+}
 
-            // --- gunpowder ---
-            if(t==Element::GUNPOWDER){
-                for(int dy=-1;dy<=1;++dy)
-                    for(int dx=-1;dx<=1;++dx){
-                        if(!dx && !dy) continue;
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        Element ne=grid[ny][nx].type;
-                        if(ne==Element::FIRE || ne==Element::LAVA){
-                            explode(x,y,5);
-                            break;
-                        }
-                    }
-                updated[y][x]=true;
-                continue;
-            }
+// Pan so the cursor stays at least a few cells from the view's edges; if it
+// is out of view altogether (start-up, a load, a big jump), centre on it.
+static int follow(int cam, int cur, int view, int world){
+    const int margin=std::min(4, view/4);
+    if(cur<cam || cur>=cam+view) cam=cur-view/2;
+    else if(cur<cam+margin) cam=cur-margin;
+    else if(cur>cam+view-1-margin) cam=cur-view+1+margin;
+    return std::clamp(cam, 0, std::max(0, world-view));
+}
 
-            // --- wire / metal conduction ---
-            if(t==Element::WIRE || t==Element::METAL){
-                if(cell.life>0){
-                    int q=cell.life;
-                    for(int dy=-1;dy<=1;++dy)
-                        for(int dx=-1;dx<=1;++dx){
-                            if(!dx && !dy) continue;
-                            int nx=x+dx, ny=y+dy;
-                            if(!in_bounds(nx,ny)) continue;
-                            Cell &n=grid[ny][nx];
-                            if(n.type==Element::WIRE || n.type==Element::METAL){
-                                if(n.life<q-1) n.life=q-1;
-                            }
-                            // wire can shock water too
-                            if(n.type==Element::WATER || n.type==Element::SALTWATER){
-                                if(n.life<q-1) n.life=q-1;
-                            }
-                            if(flammable(n.type) && chance(15)){
-                                if(n.type==Element::GUNPOWDER) explode(nx,ny,5);
-                                else { n.type=Element::FIRE; n.life=15+rint(0,10); }
-                            }
-                            if(n.type==Element::HYDROGEN || n.type==Element::GAS){
-                                if(chance(35)) explode(nx,ny,4);
-                            }
-                        }
-                    cell.life--;
-                    if(cell.life<0) cell.life=0;
-                }
-                updated[y][x]=true;
-                continue;
-            }
+// Copy the window a termW x termH terminal shows around the cursor (cx,cy).
+static void capture_view(View& v, int cx,int cy, Element cur, bool paused, int brush, bool pen,
+                         int termW,int termH){
+    TRACE_SCOPE("capture_view");
+    v.w=std::min(gWidth,termW);
+    v.h=std::min(gHeight,std::max(1,termH-3));
+    gCamX=follow(gCamX,cx,v.w,gWidth);
+    gCamY=follow(gCamY,cy,v.h,gHeight);
+    v.camX=gCamX; v.camY=gCamY;
+    v.worldW=gWidth; v.worldH=gHeight;
+    v.cells.resize((size_t)v.w*v.h);
+    for(int y=0;y<v.h;++y){
+        const int row=(v.camY+y)*gWidth+v.camX;
+        uint16_t* out=&v.cells[(size_t)y*v.w];
+        for(int x=0;x<v.w;++x) out[x]=visual_of(row+x);
+    }
+    v.cx=cx; v.cy=cy; v.brush=brush;
+    v.current=cur; v.paused=paused; v.pen=pen;
+    v.message=gMessage;
+}
 
-            // --- ice ---
-            if(t==Element::ICE){
-                for(int dy=-1;dy<=1;++dy)
-                    for(int dx=-1;dx<=1;++dx){
-                        int nx=x+dx, ny=y+dy;
-                        if(!in_bounds(nx,ny)) continue;
-                        Element ne=grid[ny][nx].type;
-                        if(ne==Element::FIRE || ne==Element::LAVA || ne==Element::STEAM){
-                            if(chance(25)){
-                                cell.type=Element::WATER;
-                                cell.life=0;
-                            }
-                        }
-                    }
-                updated[y][x]=true;
-                continue;
-            }
+static void draw_grid(const View& v){
+    TRACE_SCOPE("draw_grid");
+    int maxy,maxx; getmaxyx(stdscr,maxy,maxx);
+    // a view taken for a bigger terminal just gets cut off
+    const int viewW=std::min(v.w,maxx);
+    const int viewH=std::min(v.h,std::max(1,maxy-3));
+    const size_t n=(size_t)viewW*viewH;
+    if(gRedrawAll.exchange(false) || gDrawn.size()!=n || gDrawnW!=viewW){
+        erase();
+        gDrawn.assign(n, 0xFFFF);
+        gDrawnW=viewW;
+        gDrawnStatus.clear();
+        gDrawnInfo.clear();
+        if(viewH<maxy) mvhline(viewH,0,'-',maxx);
+    }
 
-            // default static
-            updated[y][x]=true;
+    const bool colors = has_colors();
+    for(int y=0;y<viewH;++y){
+        const uint16_t* cells=&v.cells[(size_t)y*v.w];
+        uint16_t* drawn=&gDrawn[(size_t)y*viewW];
+        for(int x=0;x<viewW;++x){
+            const bool cursor = v.camX+x==v.cx && v.camY+y==v.cy;
+            uint16_t c = cursor ? (uint16_t)'+' : cells[x];
+            if(c==drawn[x]) continue;
+            drawn[x]=c;
+            chtype ch = (chtype)(c&0xFF);
+            if(colors && (c>>8)) ch |= COLOR_PAIR(c>>8);
+            mvaddch(y,x,ch);
         }
     }
+
+    if(viewH+1<maxy)
+        draw_status_line(viewH+1,
+            "Move: Arrows/WASD | Space: draw | b: pen | G: fill | E: erase | +/-: brush | C/X: clear | "
+            "P: pause | M/Tab: elements | V/O: save/load | F: perf | Q: quit", gDrawnStatus, maxx);
+
+    if(viewH+2<maxy)
+        draw_status_line(viewH+2,
+            std::string("Current: ")+name_of(v.current)+
+            " | Brush r="+std::to_string(v.brush)+(v.pen?" (pen down)":"")+
+            (viewW<v.worldW || viewH<v.worldH
+                ? " | "+std::to_string(v.cx)+","+std::to_string(v.cy)+" of "+
+                  std::to_string(v.worldW)+"x"+std::to_string(v.worldH) : "")+
+            (v.paused?" [PAUSED]":"")+
+            (v.message.empty()?"":" | "+v.message), gDrawnInfo, maxx);
 }
+// ===== Frame dump =====
+// --dump-frames DIR writes the world every --every N ticks as one pixel per
+// cell, coloured like the terminal view: binary PPM, or with --dump-raw a
+// PGM whose grey levels are the colour pair numbers (indexed colour, for
+// diffing runs). The sim thread only copies each frame's colour pairs into a
+// recycled buffer; encoding and writing happen on a writer thread fed by a
+// queue of at most DUMP_QUEUE frames, and capture blocks only when the disk
+// falls that far behind.
+static constexpr size_t DUMP_QUEUE = 8;
+
+// RGB of each colour pair's foreground (see init_pair in main), xterm palette
+static constexpr uint8_t PAIR_RGB[10][3] = {
+    {229,229,229},                                // 0: default
+    {  0,  0,  0}, {205,205,  0}, {  0,205,205},  // black, yellow, cyan
+    {229,229,229}, {  0,205,  0}, {205,  0,  0},  // white, green, red
+    {205,  0,205}, {  0,  0,238}, {205,205,  0},  // magenta, blue, yellow
+};
 
-// ===== Drawing =====
-static void draw_grid(int cx,int cy, Element cur, bool paused, int brush){
-    for(int y=0;y<gHeight;++y){
-        for(int x=0;x<gWidth;++x){
-            Cell &c=grid[y][x];
-            char ch = glyph_of(c.type);
-
-            // little "animations" / stick vibes
-            if(c.type==Element::HUMAN)  ch = (c.life/6)%2 ? 'y' : 'Y';
-            if(c.type==Element::ZOMBIE) ch = (c.life/6)%2 ? 't' : 'T';
-            if(c.type==Element::LIGHTNING) ch='|'; // straight yellow bolt
-
-            short col = color_of(c.type);
-            // electrified water pulse = yellow
-            if((c.type==Element::WATER || c.type==Element::SALTWATER) && c.life>0){
-                col = 9;
+class FrameDumper {
+public:
+    FrameDumper(std::string dir, bool raw) : dir_(std::move(dir)), raw_(raw) {
+        thread_=std::thread([this]{ writer_loop(); });
+    }
+    ~FrameDumper(){ finish(); }
+    FrameDumper(const FrameDumper&) = delete;
+    FrameDumper& operator=(const FrameDumper&) = delete;
+
+    // queue the current world as frame `frame` (once: a paused replay may
+    // offer the same frame again); waits only while the queue is full
+    void capture(uint64_t frame){
+        if(frame==last_) return;
+        last_=frame;
+        TRACE_SCOPE("dump_capture");
+        Frame f;
+        {
+            std::unique_lock<std::mutex> lk(m_);
+            spaceCv_.wait(lk,[&]{ return queue_.size()<DUMP_QUEUE; });
+            if(!spare_.empty()){ f.pairs.swap(spare_.back()); spare_.pop_back(); }
+        }
+        f.frame=frame; f.w=gWidth; f.h=gHeight;
+        f.pairs.resize((size_t)gWidth*gHeight);
+        for(size_t i=0;i<f.pairs.size();++i) f.pairs[i]=(uint8_t)color_at((int)i);
+        {
+            std::lock_guard<std::mutex> lk(m_);
+            queue_.push_back(std::move(f));
+        }
+        workCv_.notify_one();
+    }
+
+    // write out everything queued and stop the writer; false if a write failed
+    bool finish(){
+        if(thread_.joinable()){
+            { std::lock_guard<std::mutex> lk(m_); quit_=true; }
+            workCv_.notify_one();
+            thread_.join();
+        }
+        return err_.empty();
+    }
+    const std::string& error() const { return err_; }
+    uint64_t written() const { return written_; }
+
+private:
+    struct Frame {
+        uint64_t frame=0;
+        int w=0, h=0;
+        std::vector<uint8_t> pairs;
+    };
+    std::string dir_;
+    bool raw_;
+    std::thread thread_;
+    std::mutex m_;
+    std::condition_variable workCv_, spaceCv_;
+    std::vector<Frame> queue_;                // oldest first
+    std::vector<std::vector<uint8_t>> spare_;  // written frames' buffers, for reuse
+    bool quit_=false;
+    uint64_t last_=UINT64_MAX;                // last frame captured
+    std::string err_;                         // first failure; later frames are dropped
+    uint64_t written_=0;
+
+    void writer_loop(){
+        std::string out;
+        for(;;){
+            Frame f;
+            {
+                std::unique_lock<std::mutex> lk(m_);
+                workCv_.wait(lk,[&]{ return quit_ || !queue_.empty(); });
+                if(queue_.empty()) return;
+                f=std::move(queue_.front());
+                queue_.erase(queue_.begin());
             }
+            if(err_.empty() && write_frame(f,out)) ++written_;
+            {
+                std::lock_guard<std::mutex> lk(m_);
+                spare_.push_back(std::move(f.pairs));
+            }
+            spaceCv_.notify_one();
+        }
+    }
 
-            if(has_colors()) attron(COLOR_PAIR(col));
-            mvaddch(y,x,ch);
-            if(has_colors()) attroff(COLOR_PAIR(col));
+    bool write_frame(const Frame& f, std::string& out){
+        TRACE_SCOPE("dump_write");
+        char name[32];
+        std::snprintf(name,sizeof name,"/frame_%06llu.%s",(unsigned long long)f.frame,raw_?"pgm":"ppm");
+        char header[64];
+        const int n=std::snprintf(header,sizeof header,"%s\n%d %d\n255\n",raw_?"P5":"P6",f.w,f.h);
+        out.assign(header,n);
+        if(raw_){
+            out.append((const char*)f.pairs.data(),f.pairs.size());
+        }else{
+            out.resize(out.size()+f.pairs.size()*3);
+            char* px=&out[n];
+            for(uint8_t c : f.pairs){ std::memcpy(px,PAIR_RGB[c],3); px+=3; }
+        }
+        return write_file(dir_+name,out,err_);
+    }
+};
+
+// ===== Performance HUD =====
+// Toggled with F. Times every sim tick and every redraw the main loop makes,
+// keeps the last HUD_WINDOW of each for rolling percentiles, and overlays the
+// numbers plus gLastTick's phase/category breakdown in the top-right corner.
+// The sim side is copied into a HudView next to the View, so it is drawn from
+// the same tick as the grid.
+static constexpr int HUD_WINDOW = 128;
+
+struct RollingMs {
+    float v[HUD_WINDOW] = {};
+    int n = 0;   // samples pushed so far
+    void push(double ms){ v[n++%HUD_WINDOW]=(float)ms; }
+    double last() const { return n ? v[(n-1)%HUD_WINDOW] : 0.0; }
+    double pct(double p) const {
+        int k=std::min(n,HUD_WINDOW);
+        if(!k) return 0.0;
+        float tmp[HUD_WINDOW];
+        std::copy(v,v+k,tmp);
+        int at=std::min(k-1,(int)(p*k));
+        std::nth_element(tmp,tmp+at,tmp+k);
+        return tmp[at];
+    }
+};
+
+struct PerfHud {
+    std::atomic<bool> shown{false};
+    RollingMs sim, draw;
+    double tps=0;
+    int ticks=0;
+    std::chrono::steady_clock::time_point rateStart=std::chrono::steady_clock::now();
+
+    void tick(double ms){
+        sim.push(ms);
+        ++ticks;
+        auto now=std::chrono::steady_clock::now();
+        double secs=std::chrono::duration<double>(now-rateStart).count();
+        if(secs>=1.0){
+            tps=ticks/secs;
+            ticks=0;
+            rateStart=now;
         }
     }
+};
+static PerfHud gHud;
 
-    if(in_bounds(cx,cy)) mvaddch(cy,cx,'+');
+struct HudView {
+    bool shown=false;
+    RollingMs sim;
+    double tps=0;
+    TickStats tick;
+};
 
-    int maxy,maxx; getmaxyx(stdscr,maxy,maxx);
-    if(gHeight<maxy) mvhline(gHeight,0,'-',maxx);
+static void capture_hud(HudView& h){
+    h.shown=gHud.shown;
+    if(!h.shown) return;
+    h.sim=gHud.sim;
+    h.tps=gHud.tps;
+    h.tick=gLastTick;
+}
+
+// Draw the overlay over the grid, and mark the cells under it as stale so the
+// next draw_grid repaints them (or the HUD covers them again).
+static void draw_hud(const HudView& h){
+    if(!h.shown) return;
+    TRACE_SCOPE("draw_hud");
+    const TickStats& t=h.tick;
+    uint32_t total=0;
+    for(uint32_t c : t.cells) total+=c;
+
+    char lines[7][64];
+    std::snprintf(lines[0],64,"sim  %6.2f ms  p50 %6.2f  p99 %6.2f",
+                  h.sim.last(), h.sim.pct(0.50), h.sim.pct(0.99));
+    std::snprintf(lines[1],64,"draw %6.2f ms  p50 %6.2f  p99 %6.2f",
+                  gHud.draw.last(), gHud.draw.pct(0.50), gHud.draw.pct(0.99));
+    std::snprintf(lines[2],64,"sweep %.2f  blast %.2f  charge %.2f ms",
+                  t.sweepMs, t.blastMs, t.chargeMs);
+    std::snprintf(lines[3],64,"ticks/s %5.1f  cells updated %u", h.tps, total);
+    std::snprintf(lines[4],64,"%-7s %-7u %-7s %-7u %-7s %u", STAT_NAMES[S_POWDER], t.cells[S_POWDER],
+                  STAT_NAMES[S_LIQUID], t.cells[S_LIQUID], STAT_NAMES[S_GAS], t.cells[S_GAS]);
+    std::snprintf(lines[5],64,"%-7s %-7u %-7s %-7u", STAT_NAMES[S_FIRE], t.cells[S_FIRE],
+                  STAT_NAMES[S_ACTOR], t.cells[S_ACTOR]);
+    std::snprintf(lines[6],64,"%-7s %-7u %-7s %u", STAT_NAMES[S_CONDUCTOR], t.cells[S_CONDUCTOR],
+                  STAT_NAMES[S_OTHER], t.cells[S_OTHER]);
 
-    std::string status =
-        "Move: Arrows/WASD | Space: draw | E: erase | +/-: brush | C/X: clear | "
-        "P: pause | M/Tab: elements | Q: quit";
-    if((int)status.size()>maxx) status.resize(maxx);
-    if(gHeight+1<maxy) mvaddnstr(gHeight+1,0,status.c_str(),maxx);
+    int maxy,maxx; getmaxyx(stdscr,maxy,maxx);
+    const int boxW=std::min(maxx,42);
+    const int boxH=std::min(maxy,7);
+    const int x0=maxx-boxW;
+    attron(A_REVERSE);
+    for(int y=0;y<boxH;++y){
+        mvhline(y,x0,' ',boxW);
+        mvaddnstr(y,x0+1,lines[y],boxW-1);
+    }
+    attroff(A_REVERSE);
 
-    std::string info =
-        "Current: "+name_of(cur)+
-        " | Brush r="+std::to_string(brush)+
-        (paused?" [PAUSED]":"");
-    if((int)info.size()>maxx) info.resize(maxx);
-    if(gHeight+2<maxy) mvaddnstr(gHeight+2,0,info.c_str(),maxx);
+    if(gDrawnW<=0) return;
+    const int rows=std::min(boxH,(int)(gDrawn.size()/gDrawnW));
+    for(int y=0;y<rows;++y)
+        for(int x=x0;x<gDrawnW;++x)
+            gDrawn[(size_t)y*gDrawnW+x]=0xFFFF;
 }
 
 // ===== Element Browser & Credits =====
@@ -1291,8 +2716,547 @@ static Element element_menu(Element current){
     return result;
 }
 
+// ===== Input recording =====
+// Everything the player does goes through apply_event, stamped with the tick
+// it happened before. Since the simulation only draws from seeded RNG
+// streams, a recording is just the starting world, the settings that change
+// which random numbers get drawn, and that event list; replaying it
+// reproduces the session exactly. A session's ticks begin at the snapshot's
+// frame, so the stamps stay valid across resizes and reloads. A world
+// reloaded with O is stored in the recording too (a LOAD event), so the
+// replay doesn't depend on what the file holds by then.
+
+struct Ui {
+    int cx=0, cy=0;
+    int brush=1;
+    Element current=Element::SAND;
+    bool running=true, paused=false;
+    bool pen=false;         // pen down: moving the cursor draws a stroke
+    bool replaying=false;   // don't touch files on disk while replaying
+    std::string savePath;
+};
+
+// RESIZE only appears in recordings from when the world followed the terminal size
+enum class EventKind : int32_t { KEY, SELECT, RESIZE, END, LOAD };
+
+struct InputEvent {
+    uint64_t tick;   // gFrame when the event was applied
+    int32_t kind;
+    int32_t a, b;    // key code, element id, new world size, or index into Recording::worlds
+};
+
+static constexpr char     REC_MAGIC[4] = {'P','W','R','C'};
+static constexpr uint32_t REC_VERSION  = 2;   // 1 had no reloaded worlds
+
+enum RecFlag : uint8_t { R_SLEEP=1, R_CHARGE_NET=2, R_PARALLEL=4 };
+
+struct Recording {
+    uint8_t flags=0;
+    std::string world;                 // encode_world snapshot at the first tick
+    std::vector<InputEvent> events;    // ends with an END event
+    std::vector<std::string> worlds;   // files reloaded with O, as read
+};
+
+static void clamp_cursor(Ui& ui){
+    ui.cx=std::clamp(ui.cx,0,gWidth-1);
+    ui.cy=std::clamp(ui.cy,0,gHeight-1);
+}
+
+// cursor movement; false if ch is not a movement key
+static bool move_cursor(Ui& ui, int ch){
+    if(ch==KEY_LEFT || ch=='a' || ch=='A'){
+        ui.cx = std::max(0,ui.cx-1);
+    }else if(ch==KEY_RIGHT || ch=='d' || ch=='D'){
+        ui.cx = std::min(gWidth-1,ui.cx+1);
+    }else if(ch==KEY_UP || ch=='w'){
+        ui.cy = std::max(0,ui.cy-1);
+    }else if(ch==KEY_DOWN || ch=='s' || ch=='S'){
+        ui.cy = std::min(gHeight-1,ui.cy+1);
+    }else if(ch==KEY_SLEFT){
+        ui.cx = std::max(0,ui.cx-8);
+    }else if(ch==KEY_SRIGHT){
+        ui.cx = std::min(gWidth-1,ui.cx+8);
+    }else if(ch==KEY_SR){
+        ui.cy = std::max(0,ui.cy-8);
+    }else if(ch==KEY_SF){
+        ui.cy = std::min(gHeight-1,ui.cy+8);
+    }else{
+        return false;
+    }
+    return true;
+}
+
+static void apply_key(Ui& ui, int ch){
+    const int px=ui.cx, py=ui.cy;
+    if(move_cursor(ui,ch)){
+        if(ui.pen && (ui.cx!=px || ui.cy!=py)) stroke_brush(px,py,ui.cx,ui.cy,ui.brush,ui.current);
+    }else if(ch=='q'||ch=='Q'){
+        ui.running=false;
+    }else if(ch==' '){
+        place_brush(ui.cx,ui.cy,ui.brush,ui.current);
+    }else if(ch=='e' || ch=='E'){
+        place_brush(ui.cx,ui.cy,ui.brush,Element::EMPTY);
+    }else if(ch=='b'){   // not 'B': that ends an undecoded down-arrow sequence
+        ui.pen=!ui.pen;
+        if(ui.pen) place_brush(ui.cx,ui.cy,ui.brush,ui.current);
+    }else if(ch=='g' || ch=='G'){
+        flood_fill(ui.cx,ui.cy,ui.current);
+    }else if(ch=='+' || ch=='='){
+        if(ui.brush<8) ++ui.brush;
+    }else if(ch=='-' || ch=='_'){
+        if(ui.brush>1) --ui.brush;
+    }else if(ch=='c' || ch=='C' || ch=='x' || ch=='X'){
+        clear_grid();
+    }else if(ch=='p' || ch=='P'){
+        ui.paused=!ui.paused;
+    }else if(ch=='f' || ch=='F'){
+        gHud.shown=!gHud.shown;
+        if(!gHud.shown) invalidate_screen();
+    }else if(ch=='v' || ch=='V'){
+        if(ui.replaying) return;
+        std::string err;
+        gMessage = save_world(ui.savePath,err) ? "saved "+ui.savePath : err;
+    }else if(ch=='o' || ch=='O'){   // replaying a version 1 recording; live sessions send LOAD
+        std::string err;
+        gMessage = load_world(ui.savePath,err) ? "loaded "+ui.savePath : err;
+        invalidate_screen();
+        clamp_cursor(ui);
+    }else if(ch=='1'){ ui.current=Element::SAND; }
+    else if(ch=='2'){ ui.current=Element::WATER; }
+    else if(ch=='3'){ ui.current=Element::STONE; }
+    else if(ch=='4'){ ui.current=Element::WOOD; }
+    else if(ch=='5'){ ui.current=Element::FIRE; }
+    else if(ch=='6'){ ui.current=Element::OIL; }
+    else if(ch=='7'){ ui.current=Element::LAVA; }
+    else if(ch=='8'){ ui.current=Element::PLANT; }
+    else if(ch=='9'){ ui.current=Element::GUNPOWDER; }
+    else if(ch=='0'){ ui.current=Element::ACID; }
+    else if(ch=='W'){ ui.current=Element::WALL; }
+    else if(ch=='L'){ ui.current=Element::LIGHTNING; }
+    else if(ch=='H' || ch=='h'){ ui.current=Element::HUMAN; }
+    else if(ch=='Z'){ ui.current=Element::ZOMBIE; }
+    else if(ch=='D'){ ui.current=Element::DIRT; }
+}
+
+static void apply_event(Ui& ui, const Recording& rec, const InputEvent& ev){
+    switch((EventKind)ev.kind){
+        case EventKind::KEY:    apply_key(ui,ev.a); break;
+        case EventKind::SELECT:
+            if(ev.a>=0 && ev.a<ELEMENT_COUNT) ui.current=(Element)ev.a;
+            break;
+        case EventKind::RESIZE:{
+            int w=std::max(1,(int)ev.a), h=std::max(1,(int)ev.b);
+            if(!world_fits(w,h)) break;
+            init_grid(w,h);
+            invalidate_screen();
+            clamp_cursor(ui);
+            break;
+        }
+        case EventKind::END:    ui.running=false; break;
+        case EventKind::LOAD:{
+            if(ev.a<0 || (size_t)ev.a>=rec.worlds.size()) break;
+            const std::string& data=rec.worlds[ev.a];
+            const std::string what = ui.replaying ? "recorded world" : ui.savePath;
+            const char* p=data.data();
+            std::string err;
+            gMessage = decode_world(p,p+data.size(),err) ? "loaded "+what : what+": "+err;
+            invalidate_screen();
+            clamp_cursor(ui);
+            break;
+        }
+    }
+}
+
+static void begin_recording(Recording& rec){
+    rec.flags = (gSleepChunks ? R_SLEEP : 0) | (gChargeNet ? R_CHARGE_NET : 0) |
+                (gPool && gPool->size()>1 ? R_PARALLEL : 0);
+    rec.world.clear();
+    encode_world(rec.world);
+    rec.events.clear();
+    rec.worlds.clear();
+}
+
+static bool save_recording(const std::string& path, const Recording& rec, std::string& err){
+    std::string out;
+    out.append(REC_MAGIC,4);
+    put(out,REC_VERSION);
+    put(out,rec.flags);
+    put(out,(uint32_t)rec.world.size());
+    out+=rec.world;
+    put(out,(uint32_t)rec.events.size());
+    for(const InputEvent& ev : rec.events){
+        put(out,ev.tick);
+        put(out,ev.kind);
+        put(out,ev.a);
+        put(out,ev.b);
+    }
+    put(out,(uint32_t)rec.worlds.size());
+    for(const std::string& w : rec.worlds){
+        put(out,(uint32_t)w.size());
+        out+=w;
+    }
+    return write_file(path,out,err);
+}
+
+static bool load_recording(const std::string& path, Recording& rec, std::string& err){
+    std::string buf;
+    if(!read_file(path,buf,err)) return false;
+    const char* p=buf.data();
+    const char* end=p+buf.size();
+    char magic[4]; uint32_t version, size, count;
+    if(!get(p,end,magic) || std::memcmp(magic,REC_MAGIC,4)!=0){ err=path+": not a recording"; return false; }
+    if(!get(p,end,version) || version<1 || version>REC_VERSION){ err=path+": unsupported version"; return false; }
+    if(!get(p,end,rec.flags) || !get(p,end,size) || (size_t)(end-p)<size){
+        err=path+": bad header"; return false;
+    }
+    rec.world.assign(p,size);
+    p+=size;
+    if(!get(p,end,count) || (size_t)(end-p)/20<count){ err=path+": truncated"; return false; }
+    rec.events.resize(count);
+    for(InputEvent& ev : rec.events){
+        get(p,end,ev.tick); get(p,end,ev.kind); get(p,end,ev.a); get(p,end,ev.b);
+    }
+    rec.worlds.clear();
+    if(version<2) return true;
+    if(!get(p,end,count)){ err=path+": truncated"; return false; }
+    for(uint32_t i=0;i<count;++i){
+        if(!get(p,end,size) || (size_t)(end-p)<size){ err=path+": truncated"; return false; }
+        rec.worlds.emplace_back(p,size);
+        p+=size;
+    }
+    return true;
+}
+
+// Restores the recorded world and settings. The thread count itself doesn't
+// matter, only whether the parallel schedule was in use.
+static bool begin_replay(const Recording& rec, int threads, std::string& err){
+    const char* p=rec.world.data();
+    if(!decode_world(p,p+rec.world.size(),err)) return false;
+    gSleepChunks = rec.flags & R_SLEEP;
+    gChargeNet   = rec.flags & R_CHARGE_NET;
+    if(!(rec.flags & R_PARALLEL)) gPool.reset();
+    else if(!gPool || gPool->size()<2) gPool=std::make_unique<ThreadPool>(std::max(2,threads));
+    return true;
+}
+
+// Applies the events due at the current tick and steps once.
+// Returns false when the recording is over.
+static bool replay_tick(Ui& ui, const Recording& rec, size_t& next){
+    bool any=false;
+    while(next<rec.events.size() && rec.events[next].tick<=gFrame){
+        apply_event(ui,rec,rec.events[next++]);
+        any=true;
+    }
+    if(!ui.running || next>=rec.events.size()) return false;
+    if(!ui.paused) step_sim();
+    else if(!any) return false;   // paused with nothing left to unpause it
+    return true;
+}
+
+// ===== Headless benchmark =====
+struct Options {
+    bool headless = false;
+    int width = 400, height = 200;
+    bool sized = false;   // --width/--height given; otherwise the world fills the terminal
+    int frames = 1000;
+    std::string scene = "mixed";
+    bool seeded = false;
+    uint64_t seed = 0;
+    bool sleep = true;
+    int threads = 1;
+    bool chargeNet = false;
+    bool pipeline = false;   // interactive: sim and drawing on separate threads
+    std::string load, save;
+    std::string record, replay;
+    std::string trace;   // Chrome trace-event JSON output
+    std::string dumpDir; // headless frame images
+    int every = 1;       // dump every N-th tick
+    bool dumpRaw = false;
+    int tps = 60;   // simulation ticks per second (interactive)
+    int fps = 60;   // redraws per second (interactive)
+};
+
+static void usage(const char* argv0){
+    std::fprintf(stderr,
+        "usage: %s [--headless] [--width W] [--height H] [--frames N] [--scene NAME] [--seed S]\n"
+        "          [--no-sleep] [--threads N] [--charge-net] [--pipeline] [--load FILE] [--save FILE]\n"
+        "          [--record FILE] [--replay FILE] [--tps N] [--fps N] [--trace FILE]\n"
+        "          [--dump-frames DIR [--every N] [--dump-raw]]\n"
+        "scenes: empty, sand, water, flood, fire, gunpowder, zombies, terrain, circuit, mixed\n", argv0);
+}
+
+static bool parse_args(int argc,char** argv, Options& o){
+    for(int i=1;i<argc;++i){
+        const char* a=argv[i];
+        auto next_int = [&](int& out)->bool{
+            if(i+1>=argc) return false;
+            out=std::atoi(argv[++i]);
+            return true;
+        };
+        if(!std::strcmp(a,"--headless")) o.headless=true;
+        else if(!std::strcmp(a,"--width")){ if(!next_int(o.width)) return false; o.sized=true; }
+        else if(!std::strcmp(a,"--height")){ if(!next_int(o.height)) return false; o.sized=true; }
+        else if(!std::strcmp(a,"--frames")){ if(!next_int(o.frames)) return false; }
+        else if(!std::strcmp(a,"--scene")){ if(i+1>=argc) return false; o.scene=argv[++i]; }
+        else if(!std::strcmp(a,"--no-sleep")) o.sleep=false;
+        else if(!std::strcmp(a,"--charge-net")) o.chargeNet=true;
+        else if(!std::strcmp(a,"--pipeline")) o.pipeline=true;
+        else if(!std::strcmp(a,"--load")){ if(i+1>=argc) return false; o.load=argv[++i]; }
+        else if(!std::strcmp(a,"--save")){ if(i+1>=argc) return false; o.save=argv[++i]; }
+        else if(!std::strcmp(a,"--record")){ if(i+1>=argc) return false; o.record=argv[++i]; }
+        else if(!std::strcmp(a,"--replay")){ if(i+1>=argc) return false; o.replay=argv[++i]; }
+        else if(!std::strcmp(a,"--trace")){ if(i+1>=argc) return false; o.trace=argv[++i]; }
+        else if(!std::strcmp(a,"--dump-frames")){ if(i+1>=argc) return false; o.dumpDir=argv[++i]; }
+        else if(!std::strcmp(a,"--every")){ if(!next_int(o.every)) return false; }
+        else if(!std::strcmp(a,"--dump-raw")) o.dumpRaw=true;
+        else if(!std::strcmp(a,"--threads")){ if(!next_int(o.threads)) return false; }
+        else if(!std::strcmp(a,"--tps")){ if(!next_int(o.tps)) return false; }
+        else if(!std::strcmp(a,"--fps")){ if(!next_int(o.fps)) return false; }
+        else if(!std::strcmp(a,"--seed")){
+            if(i+1>=argc) return false;
+            o.seed=std::strtoull(argv[++i],nullptr,0);
+            o.seeded=true;
+        }
+        else return false;
+    }
+    return world_fits(o.width,o.height) && o.frames>=0 && o.threads>=1 && o.tps>0 && o.fps>0 && o.every>0;
+}
+
+// fill a rectangle, clipped to the grid
+static void fill_rect(int x0,int y0,int x1,int y1, Element e){
+    for(int y=std::max(0,y0); y<=std::min(gHeight-1,y1); ++y)
+        for(int x=std::max(0,x0); x<=std::min(gWidth-1,x1); ++x){
+            const int c = idx(x,y);
+            set_cell(c,e,info(e).life);
+        }
+}
+
+// deterministic-ish stress scenes for the benchmark runner
+static bool build_scene(const std::string& name){
+    int w=gWidth, h=gHeight;
+    if(name=="empty") return true;
+    // every scene gets a floor and side walls so matter stays in the world
+    fill_rect(0,h-1,w-1,h-1,Element::WALL);
+    fill_rect(0,0,0,h-1,Element::WALL);
+    fill_rect(w-1,0,w-1,h-1,Element::WALL);
+
+    if(name=="sand"){
+        for(int x=1;x<w-1;x+=2) fill_rect(x,0,x,h/2,Element::SAND);
+    }else if(name=="water"){
+        fill_rect(1,0,w-2,h/2,Element::WATER);
+        fill_rect(w/3,h/2,w/3,h-2,Element::STONE);
+    }else if(name=="flood"){
+        // a reservoir let go into a wide empty basin
+        fill_rect(0,h-2,w-1,h-1,Element::STONE);
+        fill_rect(1,h/3,w/6,h-3,Element::WATER);
+    }else if(name=="fire"){
+        fill_rect(1,h/2,w-2,h-2,Element::WOOD);
+        fill_rect(1,h/2-2,w-2,h/2-1,Element::OIL);
+        for(int x=1;x<w-1;x+=8) fill_rect(x,h/2-3,x,h/2-3,Element::FIRE);
+    }else if(name=="gunpowder"){
+        fill_rect(1,h/3,w-2,h-2,Element::GUNPOWDER);
+        fill_rect(w/2,h/3-1,w/2,h/3-1,Element::FIRE);
+    }else if(name=="zombies"){
+        fill_rect(1,h-4,w-2,h-2,Element::STONE);
+        for(int x=2;x<w-2;x+=3) fill_rect(x,h-5,x,h-5,(x/3)%4 ? Element::HUMAN : Element::ZOMBIE);
+    }else if(name=="terrain"){
+        // mostly settled ground with a few pockets of activity
+        fill_rect(1,h/5,w-2,h-2,Element::STONE);
+        for(int x=w/8;x<w-w/8;x+=std::max(1,w/4)) fill_rect(x,h/2,x+w/16,h/2+h/10,Element::EMPTY);
+        fill_rect(w/3,h/5-4,w/3+w/10,h/5-1,Element::WATER);
+        fill_rect(w/3-1,h/5-4,w/3-1,h/5-1,Element::WALL);
+        fill_rect(w/3+w/10+1,h/5-4,w/3+w/10+1,h/5-1,Element::WALL);
+        for(int x=2;x<w/4;x+=7) fill_rect(x,h/5-1,x,h/5-1,Element::HUMAN);
+    }else if(name=="circuit"){
+        // serpentine wire over a salt water lake, struck by lightning
+        int lake=h-h/4;
+        for(int y=2;y<lake;y+=4){
+            fill_rect(1,y,w-2,y,Element::WIRE);
+            int x=((y/4)%2) ? 1 : w-2;
+            fill_rect(x,y,x,std::min(y+4,lake),Element::WIRE);
+        }
+        fill_rect(1,lake,w-2,h-2,Element::SALTWATER);
+        for(int x=4;x<w-4;x+=w/6) fill_rect(x,0,x,1,Element::LIGHTNING);
+    }else if(name=="mixed"){
+        fill_rect(1,h-h/5,w-2,h-2,Element::STONE);
+        fill_rect(1,h-h/5-3,w/4,h-h/5-1,Element::DIRT);
+        fill_rect(w/4+1,h/3,w/2,h-h/5-1,Element::WATER);
+        fill_rect(w/2+1,h/2,w/2+w/8,h-h/5-1,Element::WOOD);
+        fill_rect(w/2+w/8+1,h/2,w-2,h-h/5-1,Element::GUNPOWDER);
+        for(int x=2;x<w/4;x+=2) fill_rect(x,0,x,h/4,Element::SAND);
+        for(int x=w/2+1;x<w/2+w/8;x+=6) fill_rect(x,h/2-1,x,h/2-1,Element::FIRE);
+        for(int x=2;x<w/4;x+=5) fill_rect(x,h-h/5-4,x,h-h/5-4,(x/5)%3 ? Element::HUMAN : Element::ZOMBIE);
+    }else{
+        return false;
+    }
+    return true;
+}
+
+static void print_counts(){
+    int counts[ELEMENT_COUNT] = {};
+    for(Element e : gType) counts[(int)e]++;
+    for(int i=0;i<ELEMENT_COUNT;++i)
+        if(counts[i]) std::printf("  %-10s %d\n", name_of((Element)i), counts[i]);
+}
+
+// --dump-frames: a dumper writing into o.dumpDir (created if missing), or
+// null when not dumping or the directory can't be made
+static std::unique_ptr<FrameDumper> start_dump(const Options& o, std::string& err){
+    if(o.dumpDir.empty()) return nullptr;
+    if(mkdir(o.dumpDir.c_str(),0777)!=0 && errno!=EEXIST){
+        err="cannot create "+o.dumpDir;
+        return nullptr;
+    }
+    return std::make_unique<FrameDumper>(o.dumpDir,o.dumpRaw);
+}
+static void dump_tick(FrameDumper* dump, const Options& o){
+    if(dump && gFrame%(uint64_t)o.every==0) dump->capture(gFrame);
+}
+static bool finish_dump(FrameDumper* dump, const Options& o){
+    if(!dump) return true;
+    if(!dump->finish()){
+        std::fprintf(stderr,"%s\n",dump->error().c_str());
+        return false;
+    }
+    std::printf("dumped %llu frames to %s\n",(unsigned long long)dump->written(),o.dumpDir.c_str());
+    return true;
+}
+
+static int run_replay_headless(const Options& o){
+    Recording rec;
+    std::string err;
+    if(!load_recording(o.replay,rec,err) || !begin_replay(rec,o.threads,err)){
+        std::fprintf(stderr,"%s\n",err.c_str());
+        return 1;
+    }
+    Ui ui;
+    ui.cx=gWidth/2; ui.cy=gHeight/2;
+    ui.replaying=true;
+    std::unique_ptr<FrameDumper> dump=start_dump(o,err);
+    if(!err.empty()){
+        std::fprintf(stderr,"%s\n",err.c_str());
+        return 1;
+    }
+
+    uint64_t first=gFrame;
+    size_t next=0;
+    auto t0=std::chrono::steady_clock::now();
+    dump_tick(dump.get(),o);
+    while(replay_tick(ui,rec,next)) dump_tick(dump.get(),o);
+    auto t1=std::chrono::steady_clock::now();
+
+    std::printf("replay=%s size=%dx%d frames=%llu events=%zu seed=%llu\n", o.replay.c_str(),
+                gWidth, gHeight, (unsigned long long)(gFrame-first), rec.events.size(),
+                (unsigned long long)gSeed);
+    std::printf("time=%.3f s\n", std::chrono::duration<double>(t1-t0).count());
+    print_counts();
+    if(!finish_dump(dump.get(),o)) return 1;
+
+    if(!o.save.empty() && !save_world(o.save,err)){
+        std::fprintf(stderr,"%s\n",err.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+// --load: a saved world brings its own seed unless --seed overrides it
+static bool load_start_world(const Options& o, std::string& err){
+    if(!load_world(o.load,err)) return false;
+    if(o.seeded){
+        gSeed=o.seed;
+        rng.reseed(gSeed,0);
+    }
+    return true;
+}
+
+static int run_headless(const Options& o){
+    if(!o.replay.empty()) return run_replay_headless(o);
+    std::string err;
+    if(!o.load.empty()){
+        auto l0=std::chrono::steady_clock::now();
+        if(!load_start_world(o,err)){
+            std::fprintf(stderr,"%s\n",err.c_str());
+            return 1;
+        }
+        auto l1=std::chrono::steady_clock::now();
+        std::printf("loaded %s in %.2f ms\n", o.load.c_str(),
+                    std::chrono::duration<double,std::milli>(l1-l0).count());
+    }else{
+        init_grid(o.width,o.height);
+        if(!build_scene(o.scene)){
+            std::fprintf(stderr,"unknown scene '%s'\n",o.scene.c_str());
+            return 2;
+        }
+    }
+    std::unique_ptr<FrameDumper> dump=start_dump(o,err);
+    if(!err.empty()){
+        std::fprintf(stderr,"%s\n",err.c_str());
+        return 1;
+    }
+
+    uint64_t updates=0;   // cells actually updated, summed over the run
+    auto t0=std::chrono::steady_clock::now();
+    dump_tick(dump.get(),o);
+    for(int f=0; f<o.frames; ++f){
+        step_sim();
+        for(uint32_t n : gLastTick.cells) updates+=n;
+        dump_tick(dump.get(),o);
+    }
+    auto t1=std::chrono::steady_clock::now();
+
+    double secs = std::chrono::duration<double>(t1-t0).count();
+    double cells = (double)gWidth*gHeight*o.frames;
+    std::printf("%s=%s size=%dx%d frames=%d seed=%llu threads=%d\n",
+                o.load.empty() ? "scene" : "load", o.load.empty() ? o.scene.c_str() : o.load.c_str(),
+                gWidth, gHeight, o.frames, (unsigned long long)gSeed, o.threads);
+    std::printf("time=%.3f s  fps=%.1f  updates=%llu  ns/update=%.2f  ns/world-cell=%.2f\n",
+                secs, secs>0 ? o.frames/secs : 0.0, (unsigned long long)updates,
+                updates>0 ? secs*1e9/updates : 0.0, cells>0 ? secs*1e9/cells : 0.0);
+
+    print_counts();
+    if(!finish_dump(dump.get(),o)) return 1;
+
+    if(!o.save.empty() && !save_world(o.save,err)){
+        std::fprintf(stderr,"%s\n",err.c_str());
+        return 1;
+    }
+    return 0;
+}
+
+static void finish_trace(const Options& o){
+#if POWDER_TRACE
+    std::string err;
+    if(gTraceOn && !write_trace(o.trace,err)) std::fprintf(stderr,"%s\n",err.c_str());
+#else
+    (void)o;
+#endif
+}
+
 // ===== Main =====
-int main(){
+int main(int argc,char** argv){
+    Options opts;
+    if(!parse_args(argc,argv,opts)){
+        usage(argv[0]);
+        return 2;
+    }
+    if(opts.seeded) gSeed=opts.seed;
+    gSleepChunks=opts.sleep;
+    gChargeNet=opts.chargeNet;
+    if(!opts.trace.empty()){
+#if POWDER_TRACE
+        trace_begin();
+#else
+        std::fprintf(stderr,"built with POWDER_TRACE=0, ignoring --trace\n");
+#endif
+    }
+    if(opts.threads>1) gPool=std::make_unique<ThreadPool>(opts.threads);
+    rng.reseed(gSeed,0);
+    if(opts.headless){
+        int rc=run_headless(opts);
+        finish_trace(opts);
+        return rc;
+    }
+
     initscr();
     cbreak();
     noecho();
@@ -1300,9 +3264,40 @@ int main(){
     keypad(stdscr,TRUE);
     nodelay(stdscr,TRUE);
 
+    // the world keeps its size for the whole session; resizing the terminal
+    // only changes how much of it is in view
     int termH,termW; getmaxyx(stdscr,termH,termW);
-    int simH = std::max(1, termH-3);
-    init_grid(termW,simH);
+    const int worldW = opts.sized ? opts.width : termW;
+    const int worldH = opts.sized ? opts.height : std::max(1, termH-3);
+    init_grid(worldW,worldH);
+
+    Ui ui;
+    ui.savePath = !opts.save.empty() ? opts.save
+                : !opts.load.empty() ? opts.load : "powder.sav";
+    Recording rec;
+    size_t nextEvent=0;
+    bool replaying=false;
+    if(!opts.replay.empty()){
+        std::string err;
+        replaying = load_recording(opts.replay,rec,err) && begin_replay(rec,opts.threads,err);
+        if(!replaying){
+            endwin();
+            std::fprintf(stderr,"%s\n",err.c_str());
+            return 1;
+        }
+        ui.replaying=true;
+        gMessage="replaying "+opts.replay+" (q to stop)";
+    }else if(!opts.load.empty()){
+        std::string err;
+        if(!load_start_world(opts,err)) gMessage=err;
+    }
+    bool recording = !replaying && !opts.record.empty();
+    if(recording) begin_recording(rec);
+    auto input = [&](EventKind kind, int a, int b){
+        InputEvent ev{gFrame,(int32_t)kind,a,b};
+        if(recording) rec.events.push_back(ev);
+        apply_event(ui,rec,ev);
+    };
 
     if(has_colors()){
         start_color();
@@ -1318,75 +3313,255 @@ int main(){
         init_pair(9, COLOR_YELLOW,  -1); // lightning/acid/etc
     }
 
-    int cx=gWidth/2, cy=gHeight/2;
-    int brush=1;
-    Element current=Element::SAND;
-    bool running=true, paused=false;
+    ui.cx=gWidth/2; ui.cy=gHeight/2;
+
+    // Fixed-timestep loop: the sim advances in whole ticks of simDt and
+    // catches up (at most MAX_CATCHUP ticks per pass) when it falls behind;
+    // drawing happens at most every drawDt, plus right after input. In
+    // between we sleep in poll() on stdin, so keys are handled as they arrive.
+    using Clock = std::chrono::steady_clock;
+    constexpr int MAX_CATCHUP = 5;
+    const Clock::duration simDt  = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0/opts.tps));
+    const Clock::duration drawDt = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0/opts.fps));
+
+    // what a key does to the session (the menu is opened by the UI side)
+    auto key = [&](int ch){
+        if(replaying){
+            if(ch=='q'||ch=='Q') ui.running=false;
+        }else if(ch=='o' || ch=='O'){
+            // the file's bytes go into the event, so a replay reloads the same world
+            std::string data, err;
+            if(!read_file(ui.savePath,data,err)){ gMessage=err; return; }
+            if(!recording) rec.worlds.clear();
+            rec.worlds.push_back(std::move(data));
+            input(EventKind::LOAD, (int)rec.worlds.size()-1, 0);
+        }else{
+            input(EventKind::KEY, ch, 0);
+        }
+    };
+    // one sim tick, or one step of the replay
+    auto advance = [&]{
+        auto s0=Clock::now();
+        uint64_t f0=gFrame;
+        if(replaying){
+            if(!replay_tick(ui,rec,nextEvent)){
+                replaying=false;
+                ui.running=true;
+                ui.replaying=false;
+                gMessage="replay finished";
+            }
+        }else if(!ui.paused){
+            step_sim();
+        }
+        if(gFrame!=f0) gHud.tick(std::chrono::duration<double,std::milli>(Clock::now()-s0).count());
+    };
+    auto wait_for_input = [](Clock::time_point wake){
+        Clock::time_point now=Clock::now();
+        if(wake<=now) return;
+        auto us=std::chrono::duration_cast<std::chrono::microseconds>(wake-now).count();
+        TRACE_SCOPE("poll");
+        pollfd pfd{STDIN_FILENO, POLLIN, 0};
+        poll(&pfd, 1, (int)((us+999)/1000));
+    };
+    auto present = [](const View& view, const HudView& hud){
+        auto d0=Clock::now();
+        draw_grid(view);
+        draw_hud(hud);
+        {
+            TRACE_SCOPE("refresh");
+            refresh();
+        }
+        gHud.draw.push(std::chrono::duration<double,std::milli>(Clock::now()-d0).count());
+    };
 
-    while(running){
-        // handle resize
-        int nh,nw; getmaxyx(stdscr,nh,nw);
-        int nSimH = std::max(1, nh-3);
-        if(nw!=gWidth || nSimH!=gHeight){
-            init_grid(nw,nSimH);
-            cx=std::clamp(cx,0,gWidth-1);
-            cy=std::clamp(cy,0,gHeight-1);
-        }
-
-        int ch;
-        while((ch=getch())!=ERR){
-            if(ch=='q'||ch=='Q'){
-                running=false;
-            }else if(ch==KEY_LEFT || ch=='a' || ch=='A'){
-                cx = std::max(0,cx-1);
-            }else if(ch==KEY_RIGHT || ch=='d' || ch=='D'){
-                cx = std::min(gWidth-1,cx+1);
-            }else if(ch==KEY_UP || ch=='w'){
-                cy = std::max(0,cy-1);
-            }else if(ch==KEY_DOWN || ch=='s' || ch=='S'){
-                cy = std::min(gHeight-1,cy+1);
-            }else if(ch==' '){
-                place_brush(cx,cy,brush,current);
-            }else if(ch=='e' || ch=='E'){
-                place_brush(cx,cy,brush,Element::EMPTY);
-            }else if(ch=='+' || ch=='='){
-                if(brush<8) ++brush;
-            }else if(ch=='-' || ch=='_'){
-                if(brush>1) --brush;
-            }else if(ch=='c' || ch=='C' || ch=='x' || ch=='X'){
-                clear_grid();
-            }else if(ch=='p' || ch=='P'){
-                paused=!paused;
-            }else if(ch=='m' || ch=='M' || ch=='\t'){
-                flushinp();
-                nodelay(stdscr,FALSE);
-                current = element_menu(current);
-                nodelay(stdscr,TRUE);
-            }else if(ch=='1'){ current=Element::SAND; }
-            else if(ch=='2'){ current=Element::WATER; }
-            else if(ch=='3'){ current=Element::STONE; }
-            else if(ch=='4'){ current=Element::WOOD; }
-            else if(ch=='5'){ current=Element::FIRE; }
-            else if(ch=='6'){ current=Element::OIL; }
-            else if(ch=='7'){ current=Element::LAVA; }
-            else if(ch=='8'){ current=Element::PLANT; }
-            else if(ch=='9'){ current=Element::GUNPOWDER; }
-            else if(ch=='0'){ current=Element::ACID; }
-            else if(ch=='W'){ current=Element::WALL; }
-            else if(ch=='L'){ current=Element::LIGHTNING; }
-            else if(ch=='H' || ch=='h'){ current=Element::HUMAN; }
-            else if(ch=='Z'){ current=Element::ZOMBIE; }
-            else if(ch=='D'){ current=Element::DIRT; }
-        }
-
-        if(!paused) step_sim();
+    if(!opts.pipeline){
+        View view;
+        HudView hud;
+        Clock::time_point nextSim=Clock::now(), nextDraw=nextSim;
+        while(ui.running){
+            bool redraw=false;
+
+            int nh,nw; getmaxyx(stdscr,nh,nw);
+            if(nw!=termW || nh!=termH){
+                termW=nw; termH=nh;
+                invalidate_screen();
+                redraw=true;
+            }
 
-        erase();
-        draw_grid(cx,cy,current,paused,brush);
-        refresh();
-        napms(16);
+            {
+                TRACE_SCOPE("input");
+                int ch;
+                while((ch=getch())!=ERR){
+                    redraw=true;
+                    if(!replaying && (ch=='m' || ch=='M' || ch=='\t')){
+                        flushinp();
+                        nodelay(stdscr,FALSE);
+                        Element picked = element_menu(ui.current);
+                        invalidate_screen();
+                        nodelay(stdscr,TRUE);
+                        input(EventKind::SELECT, (int)picked, 0);
+                        nextSim=nextDraw=Clock::now();   // don't fast-forward over the time spent in the menu
+                    }else{
+                        key(ch);
+                    }
+                }
+            }
+            if(!ui.running) break;
+
+            Clock::time_point now=Clock::now();
+            int steps=0;
+            for(; now>=nextSim && steps<MAX_CATCHUP; ++steps){
+                nextSim+=simDt;
+                advance();
+            }
+            if(now>=nextSim) nextSim=now;   // too far behind: drop the backlog instead of spiralling
+
+            if(redraw || now>=nextDraw){
+                capture_view(view,ui.cx,ui.cy,ui.current,ui.paused,ui.brush,ui.pen,termW,termH);
+                capture_hud(hud);
+                present(view,hud);
+                nextDraw=std::max(nextDraw+drawDt, now);
+            }
+
+            wait_for_input(std::min(nextSim,nextDraw));
+        }
+    }else{
+        // Pipelined: a sim thread owns the world and the session. At each
+        // tick it applies the keys queued since the last one, steps, and
+        // publishes a View of the result; this thread only reads keys and
+        // draws the newest published View, so a frame costs about
+        // max(sim, draw) instead of their sum. Publishing swaps buffers
+        // under the lock (sim fills `back`, `ready` is the newest, this
+        // thread draws `front`), so neither side ever waits on the other's
+        // work.
+        struct Published {
+            View view;
+            HudView hud;
+            bool running=true, replaying=false;
+        };
+        struct {
+            std::mutex m;
+            std::condition_variable cv;
+            std::vector<InputEvent> keys;   // KEY or SELECT, applied at the next tick
+            int termW=0, termH=0;
+            bool quit=false;
+            Published ready;
+            bool fresh=false;
+        } shared;
+        shared.termW=termW; shared.termH=termH;
+
+        std::thread sim([&]{
+            Published back;
+            std::vector<InputEvent> keys;
+            Clock::time_point nextSim=Clock::now();
+            for(;;){
+                int tw,th;
+                {
+                    std::unique_lock<std::mutex> lk(shared.m);
+                    shared.cv.wait_until(lk,nextSim,[&]{ return shared.quit; });
+                    if(shared.quit) return;
+                    keys.swap(shared.keys);
+                    tw=shared.termW; th=shared.termH;
+                }
+                for(const InputEvent& ev : keys){
+                    if((EventKind)ev.kind==EventKind::SELECT) input(EventKind::SELECT, ev.a, 0);
+                    else key(ev.a);
+                }
+                keys.clear();
+
+                Clock::time_point now=Clock::now();
+                for(int steps=0; ui.running && now>=nextSim && steps<MAX_CATCHUP; ++steps){
+                    nextSim+=simDt;
+                    advance();
+                }
+                if(now>=nextSim) nextSim=now+simDt;
+
+                capture_view(back.view,ui.cx,ui.cy,ui.current,ui.paused,ui.brush,ui.pen,tw,th);
+                capture_hud(back.hud);
+                back.running=ui.running;
+                back.replaying=replaying;
+                {
+                    std::lock_guard<std::mutex> lk(shared.m);
+                    std::swap(back,shared.ready);
+                    shared.fresh=true;
+                }
+                if(!ui.running) return;
+            }
+        });
+
+        Published front;
+        bool have=false;   // nothing to draw before the first tick is published
+        Clock::time_point nextDraw=Clock::now();
+        auto send = [&](EventKind kind, int a){
+            std::lock_guard<std::mutex> lk(shared.m);
+            shared.keys.push_back({0,(int32_t)kind,a,0});
+        };
+        for(;;){
+            bool redraw=false;
+
+            int nh,nw; getmaxyx(stdscr,nh,nw);
+            if(nw!=termW || nh!=termH){
+                termW=nw; termH=nh;
+                invalidate_screen();
+                redraw=true;
+                std::lock_guard<std::mutex> lk(shared.m);
+                shared.termW=termW; shared.termH=termH;
+            }
+
+            {
+                TRACE_SCOPE("input");
+                int ch;
+                while((ch=getch())!=ERR){
+                    redraw=true;
+                    if(have && !front.replaying && (ch=='m' || ch=='M' || ch=='\t')){
+                        flushinp();
+                        nodelay(stdscr,FALSE);
+                        Element picked = element_menu(front.view.current);
+                        invalidate_screen();
+                        nodelay(stdscr,TRUE);
+                        send(EventKind::SELECT, (int)picked);
+                    }else{
+                        send(EventKind::KEY, ch);
+                    }
+                }
+            }
+
+            bool fresh=false;
+            {
+                std::lock_guard<std::mutex> lk(shared.m);
+                if(shared.fresh){
+                    std::swap(front,shared.ready);
+                    shared.fresh=false;
+                    fresh=have=true;
+                }
+            }
+            if(have && !front.running) break;
+
+            Clock::time_point now=Clock::now();
+            if(have && ((redraw && fresh) || now>=nextDraw)){
+                present(front.view,front.hud);
+                nextDraw=std::max(nextDraw+drawDt, now);
+            }
+
+            wait_for_input(nextDraw);
+        }
+        {
+            std::lock_guard<std::mutex> lk(shared.m);
+            shared.quit=true;
+        }
+        shared.cv.notify_one();
+        sim.join();
     }
 
     endwin();
+    finish_trace(opts);
+    if(recording){
+        rec.events.push_back({gFrame,(int32_t)EventKind::END,0,0});
+        std::string err;
+        if(!save_recording(opts.record,rec,err)){
+            std::fprintf(stderr,"%s\n",err.c_str());
+            return 1;
+        }
+    }
     return 0;
 }